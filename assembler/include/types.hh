@@ -163,6 +163,7 @@ namespace ANC216
         unsigned char preview : 1 = 0;
         unsigned char output_size : 1 = 0;
         unsigned char get_symbol_table : 1 = 0;
+        unsigned char write_symbols : 1 = 0;
         std::string path_to_stdlib = "";
         unsigned char get_time : 1 = 0;
         std::vector<std::pair<std::string, std::string>> use_as = {};
@@ -10,6 +10,8 @@
 #include <sstream>
 #include <filesystem>
 #include <vector>
+#include <map>
+#include <iomanip>
 
 #define ASSEMBLER_VERSION_MAJOR 1
 #define ASSEMBLER_VERSION_MINOR 0
@@ -24,6 +26,7 @@ void print_error_stack(std::vector<ANC216::Error>);
 void print_help(char **);
 void print_version();
 ANC216::AsmFlags get_flags(int, char **);
+void write_symbol_table(const std::string &, const std::map<std::string, ANC216::Label> &);
 
 int main(int argc, char **argv)
 {
@@ -96,6 +99,9 @@ int main(int argc, char **argv)
 
     out_file.close();
 
+    if (flags.write_symbols)
+        write_symbol_table(flags.output_file + ".sym", analyzer.get_environment().labels);
+
     if (flags.output_size)
     {
         std::cout << CYAN << "Info: " << RESET << "the size of the output is " << a.size() << " bytes\n"
@@ -177,6 +183,11 @@ ANC216::AsmFlags get_flags(int argc, char **argv)
             flags.get_symbol_table = true;
             continue;
         }
+        if (arg == "--symbols")
+        {
+            flags.write_symbols = true;
+            continue;
+        }
 
         if (arg == "-i")
         {
@@ -267,6 +278,21 @@ ANC216::AsmFlags get_flags(int argc, char **argv)
     return flags;
 }
 
+// One label per line, the address in hexadecimal and the name. The
+// emulator reads it with --symbols
+void write_symbol_table(const std::string &filename, const std::map<std::string, ANC216::Label> &labels)
+{
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file.is_open())
+    {
+        std::cerr << RED << "Cannot write: " << RESET << "cannot open '" + filename + "'\n"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    for (auto &[name, label] : labels)
+        file << std::hex << std::setw(4) << std::setfill('0') << label.address << " " << name << "\n";
+}
+
 void print_error_stack(std::vector<ANC216::Error> error_stack)
 {
     size_t i = 1;
@@ -304,6 +330,9 @@ void print_help(char **argv)
               << CYAN << "-s" << RESET << "\t\t\t"
               << "Generate symbol table constants"
               << "\n"
+              << CYAN << "--symbols" << RESET << "\t\t"
+              << "Write the labels to <output file>.sym"
+              << "\n"
               << CYAN << "--stdlib <dir>" << RESET << "\t\t"
               << "Set standard library path"
               << "\n"
@@ -6,6 +6,8 @@
 #include <header.hh>
 #include <isa.hh>
 
+#pragma once
+
 #define X1_REG_MASK 0b11'000'111
 #define X2_REG_MASK 0b11'000'000
 
@@ -17,7 +19,7 @@ namespace ANC216
     class Disassembler
     {
     private:
-        std::ifstream &in;
+        std::istream &in;
         Header header;
 
         bool analyze(std::string &out)
@@ -119,6 +121,11 @@ namespace ANC216
             case IMMEDIATE_TO_LOW_REGISTER:
                 out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + std::string("l") + X1_GET_REG(current) + ", " + to_hex_string(add1) + "\t\t\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + "\n";
                 return true;
+            case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
+                if (size != 1)
+                    break;
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + std::string("& bp + l") + X1_GET_REG(current) + ", " + to_hex_string(add1) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + "\n";
+                return true;
             }
 
             unsigned char add2 = in.get();
@@ -159,8 +166,48 @@ namespace ANC216
                 }
                 out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + std::string("l") + X1_GET_REG(current) + ", & " + to_hex_string((unsigned short)(add1 << 8 | add2)) + "\t\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + "\n";
                 return true;
+            case IMMEDIATE_WORD:
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + to_hex_string((unsigned short)(add1 << 8 | add2)) + "\t\t\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + "\n";
+                return true;
             case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
-                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + std::string("& bp + l") + X1_GET_REG(current) + ", " + (add2 == EOF ? to_hex_string(add1) : to_hex_string((unsigned short)(add1 << 8 | add2))) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + (add2 == EOF ? "\n" : to_hex_string(add2) + "\n");
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + std::string("& bp + l") + X1_GET_REG(current) + ", " + to_hex_string((unsigned short)(add1 << 8 | add2)) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + "\n";
+                return true;
+            case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP:
+                if (size != 1)
+                    break;
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + "& bp " + signed_to_hex_string(add1) + ", " + to_hex_string(add2) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + "\n";
+                return true;
+            }
+
+            // The immediate comes after the address or the offset
+            int byte = in.get();
+            if (byte == EOF)
+                return false;
+            unsigned char add3 = byte;
+
+            switch (adr)
+            {
+            case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP:
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + "& bp " + signed_to_hex_string(add1) + ", " + to_hex_string((unsigned short)(add2 << 8 | add3)) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + " " + to_hex_string(add3) + "\n";
+                return true;
+            case IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED:
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + "& " + to_hex_string((unsigned short)(add1 << 8 | add2)) + " + l" + X1_GET_REG(current) + ", " + to_hex_string(add3) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + " " + to_hex_string(add3) + "\n";
+                return true;
+            case IMMEDIATE_TO_MEMORY_ABSOLUTE:
+                if (size != 3)
+                    break;
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + "& " + to_hex_string((unsigned short)(add1 << 8 | add2)) + ", " + to_hex_string(add3) + "\t\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + " " + to_hex_string(add3) + "\n";
+                return true;
+            }
+
+            if ((byte = in.get()) == EOF)
+                return false;
+            unsigned char add4 = byte;
+
+            switch (adr)
+            {
+            case IMMEDIATE_TO_MEMORY_ABSOLUTE:
+                out += "\t" + isa[next].first + assign_ins_space(isa[next].first) + "& " + to_hex_string((unsigned short)(add1 << 8 | add2)) + ", " + to_hex_string((unsigned short)(add3 << 8 | add4)) + "\t; " + to_hex_string(current) + " " + to_hex_string(next) + " " + to_hex_string(add1) + " " + to_hex_string(add2) + " " + to_hex_string(add3) + " " + to_hex_string(add4) + "\n";
                 return true;
             }
             return false;
@@ -400,7 +447,7 @@ namespace ANC216
         }
 
     public:
-        Disassembler(std::ifstream &in, const std::string &header_name)
+        Disassembler(std::istream &in, const std::string &header_name)
             : in(in),
               header(in)
         {
@@ -1,14 +1,16 @@
-#include <fstream>
+#include <istream>
 #include <string>
 #include <map>
 #include <tuple>
 
+#pragma once
+
 namespace ANC216
 {
     class Header
     {
     private:
-        std::ifstream &input;
+        std::istream &input;
         std::map<std::string, int> symbols;
 
         bool process_ualf()
@@ -42,7 +44,7 @@ namespace ANC216
         }
 
     public:
-        Header(std::ifstream &in)
+        Header(std::istream &in)
             : input(in)
         {
         }
@@ -0,0 +1,172 @@
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <disassembler.hh>
+
+#pragma once
+
+// Layout of the traces written by the emulator with --trace, see
+// emulator/include/trace.hh
+#define TRACE_MAGIC "ANC216TR"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+
+#define TRACE_INSTRUCTION 0
+#define TRACE_INTERRUPT 1
+
+namespace ANC216
+{
+    // Turns a binary execution trace into text, one line per instruction or
+    // interrupt, with the registers it changed and the bytes it wrote
+    class TraceDecoder
+    {
+    private:
+        std::istream &in;
+
+        bool get(int size, uint16_t &value)
+        {
+            value = 0;
+            for (int i = 0; i < size; i++)
+            {
+                int byte = in.get();
+                if (byte == EOF)
+                    return false;
+                value = value << 8 | byte;
+            }
+            return true;
+        }
+
+        std::string hex(uint16_t value, int digits)
+        {
+            std::string str(digits, '0');
+            for (int i = digits - 1; i >= 0; i--, value >>= 4)
+                str[i] = "0123456789abcdef"[value & 0xF];
+            return str;
+        }
+
+        std::string interrupt_name(uint16_t source)
+        {
+            switch (source)
+            {
+            case 0b0001:
+                return "einr";
+            case 0b0010:
+                return "nmi";
+            case 0b0100:
+                return "syscall";
+            case 0b1000:
+                return "timer";
+            }
+            return hex(source, 2);
+        }
+
+        // The instruction text as the disassembler prints it, without the
+        // indentation. Instructions it can't decode are shown as raw bytes
+        std::string disassemble(const std::vector<char> &bytes)
+        {
+            std::istringstream code(std::string(bytes.begin(), bytes.end()));
+            std::string text = Disassembler(code, "").disassemble();
+            text = text.substr(0, text.find('\n'));
+            if (!text.empty() && text.front() == '\t')
+                text.erase(0, 1);
+            if (text.find(';') != std::string::npos)
+                return text;
+
+            text = "?\t\t\t\t\t;";
+            for (char byte : bytes)
+                text += " 0x" + hex((unsigned char)byte, 2);
+            return text;
+        }
+
+        bool decode_record(std::string &out)
+        {
+            int type = in.get();
+            if (type == EOF)
+                return false;
+            uint16_t value, pc;
+
+            if (type == TRACE_INSTRUCTION)
+            {
+                uint16_t length;
+                if (!get(2, pc) || !get(1, length))
+                    return false;
+                std::vector<char> bytes(length);
+                if (!in.read(bytes.data(), length))
+                    return false;
+                out += hex(pc, 4) + ":\t" + disassemble(bytes);
+            }
+            else if (type == TRACE_INTERRUPT)
+            {
+                uint16_t source;
+                if (!get(1, source) || !get(2, pc))
+                    return false;
+                out += hex(pc, 4) + ":\tinterrupt " + interrupt_name(source);
+            }
+            else
+                return false;
+
+            uint16_t mask;
+            if (!get(2, mask))
+                return false;
+            std::string changes;
+            const char *names[] = {"r0", "r1", "r2", "r3", "r4", "r5", "r6", "r7", "sp", "bp", "sr"};
+            for (int i = 0; i < 11; i++)
+            {
+                if (!(mask & 1 << i))
+                    continue;
+                int size = i == 10 ? 1 : 2;
+                if (!get(size, value))
+                    return false;
+                changes += std::string(changes.empty() ? "" : " ") + names[i] + "=" + hex(value, size * 2);
+            }
+
+            uint16_t writes, address;
+            if (!get(2, writes))
+                return false;
+            for (uint16_t i = 0; i < writes; i++)
+            {
+                if (!get(2, address) || !get(1, value))
+                    return false;
+                changes += std::string(changes.empty() ? "" : " ") + "[" + hex(address, 4) + "]=" + hex(value, 2);
+            }
+
+            if (!changes.empty())
+                out += "\t| " + changes;
+            out += "\n";
+            return true;
+        }
+
+    public:
+        TraceDecoder(std::istream &in)
+            : in(in)
+        {
+        }
+
+        ~TraceDecoder() = default;
+
+        bool check_header()
+        {
+            char magic[TRACE_MAGIC_SIZE];
+            uint16_t version;
+            if (!in.read(magic, TRACE_MAGIC_SIZE) || std::string(magic, TRACE_MAGIC_SIZE) != TRACE_MAGIC)
+                return false;
+            return get(2, version) && version == TRACE_VERSION;
+        }
+
+        // Each record is written as soon as it is decoded, so traces of any
+        // length are decoded in constant memory. Stops at the end of the
+        // trace or at a truncated record, which is left out
+        void decode(std::ostream &out)
+        {
+            std::string record;
+            while (decode_record(record))
+            {
+                out << record;
+                record.clear();
+            }
+        }
+    };
+}
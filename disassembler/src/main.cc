@@ -4,6 +4,7 @@
 
 #include <console.hh>
 #include <disassembler.hh>
+#include <trace.hh>
 
 #define VERSION_MAJOR 1
 #define VERSION_MINOR 0
@@ -18,6 +19,7 @@ struct Flags
 {
     std::string header;
     unsigned char print_stdout : 1;
+    unsigned char trace : 1;
 };
 
 int main(int argc, char **argv)
@@ -45,7 +47,7 @@ int main(int argc, char **argv)
     }
     std::string in_filename;
     std::string out_filename;
-    Flags flags;
+    Flags flags = {};
     std::string arg;
     for (size_t i = 1; i < argc; i++)
     {
@@ -57,6 +59,11 @@ int main(int argc, char **argv)
                 flags.print_stdout = true;
                 continue;
             }
+            if (arg == "--trace")
+            {
+                flags.trace = true;
+                continue;
+            }
             if (arg.starts_with("-h="))
             {
                 if (arg != "-h=ualf")
@@ -102,10 +109,32 @@ int main(int argc, char **argv)
     in_filename = p.string();
     fs::current_path(p.parent_path());
     if (out_filename.empty())
-        out_filename = "a.anc216";
+        out_filename = flags.trace ? "trace.txt" : "a.anc216";
 
     std::ifstream in(in_filename, std::ios::binary);
+    if (flags.trace)
+    {
+        ANC216::TraceDecoder decoder(in);
+        if (!decoder.check_header())
+        {
+            std::cerr << RED << "Error: " << RESET << "'" << in_filename << "' is not an execution trace" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        if (flags.print_stdout)
+        {
+            decoder.decode(std::cout);
+            return 0;
+        }
+        std::ofstream out(out_filename, std::ios::binary);
+        decoder.decode(out);
+        return 0;
+    }
     ANC216::Disassembler dis(in, flags.header);
+    if (flags.print_stdout)
+    {
+        std::cout << dis.disassemble();
+        return 0;
+    }
     std::ofstream out(out_filename, std::ios::binary);
     out << dis.disassemble();
     out.close();
@@ -130,6 +159,9 @@ void print_help(char **argv)
               << CYAN << "--stdout" << RESET << "\t\t"
               << "Print the output in the stdout"
               << "\n"
+              << CYAN << "--trace" << RESET << "\t\t\t"
+              << "Decode an execution trace recorded with the emulator --trace flag"
+              << "\n"
               << CYAN << "-v" << RESET << "\t\t\t"
               << "Print version information"
               << "\n"
@@ -0,0 +1,12 @@
+#pragma once
+
+// Everything a program embedding the emulator needs, see doc/core.txt.
+// None of it depends on SDL
+#include <common.hh>
+#include <machine.hh>
+#include <runner.hh>
+#include <snapshot.hh>
+#include <avc64.hh>
+#include <offscreen.hh>
+#include <hash.hh>
+#include <audiocard.hh>
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <SDL.h>
+#include <sink.hh>
+#include <ring.hh>
+#include <console.hh>
+#include <iostream>
+
+// Host samples queued at most, about 190 ms
+#define AUDIO_RING_SIZE 8192
+
+namespace ANC216::Audio
+{
+    // The SDL audio device. The CPU thread pushes the samples in a ring and
+    // the SDL audio thread drains it from its callback, without locks on
+    // either side. When the guest runs ahead (--speed=max) the samples
+    // that don't fit are dropped, when it falls behind the last sample is
+    // held so that the gap doesn't click
+    class Speaker : public Sink
+    {
+    private:
+        SDL_AudioDeviceID device = 0;
+        Ring<int16_t, AUDIO_RING_SIZE> ring;
+        // Only used by the audio thread
+        int16_t last = 0;
+
+        static void callback(void *userdata, Uint8 *stream, int len)
+        {
+            Speaker *speaker = (Speaker *)userdata;
+            int16_t *out = (int16_t *)stream;
+            size_t count = len / sizeof(int16_t);
+            size_t got = speaker->ring.pop(out, count);
+            if (got > 0)
+                speaker->last = out[got - 1];
+            for (size_t i = got; i < count; i++)
+                out[i] = speaker->last;
+        }
+
+    public:
+        Speaker() = default;
+        ~Speaker()
+        {
+            if (device != 0)
+                SDL_CloseAudioDevice(device);
+        }
+
+        // Without an audio device the emulator goes on silent
+        void open(const EmuFlags &) override
+        {
+            SDL_AudioSpec want = {}, have;
+            want.freq = AUDIO_SAMPLE_RATE;
+            want.format = AUDIO_S16SYS;
+            want.channels = 1;
+            want.samples = 512;
+            want.callback = callback;
+            want.userdata = this;
+            if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0 || (device = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0)) == 0)
+            {
+                std::cerr << YELLOW << "emu::warning" << RESET << " cannot open the audio device: " << SDL_GetError() << std::endl;
+                return;
+            }
+            SDL_PauseAudioDevice(device, 0);
+        }
+
+        void write(const int16_t *samples, size_t count) override
+        {
+            if (device != 0)
+                ring.push(samples, count);
+        }
+    };
+}
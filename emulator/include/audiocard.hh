@@ -0,0 +1,80 @@
+#pragma once
+
+#include <common.hh>
+#include <sink.hh>
+#include <array>
+
+#define AUDIO_CHANNELS 4
+// The card renders the samples due every AUDIO_TICK_CYCLES, 4 ms
+#define AUDIO_TICK_CYCLES (CPU_CLOCK_HZ / 250)
+
+namespace ANC216
+{
+    // Operation bus, bits 8-11 of the words written to the card
+    enum AudioOperation
+    {
+        AUDIO_CH = 0x00,
+        AUDIO_FL = 0x01,
+        AUDIO_FH = 0x02,
+        AUDIO_VO = 0x03,
+        AUDIO_WV = 0x04,
+        AUDIO_NOP = 0x05,
+    };
+
+    enum AudioWave
+    {
+        WAVE_SQUARE,
+        WAVE_TRIANGLE,
+        WAVE_SAWTOOTH,
+        WAVE_NOISE,
+    };
+
+    struct AudioChannel
+    {
+        uint16_t frequency = 0;
+        uint8_t volume = 0;
+        uint8_t wave = WAVE_SQUARE;
+        uint32_t phase = 0;
+        // Added to the phase every sample
+        uint32_t step = 0;
+        uint16_t noise = 1;
+    };
+}
+
+// Four tone channels and an 8 bit DAC, see doc/audio.txt. Samples are
+// made for emulated time: before a register changes and on a scheduler
+// event every AUDIO_TICK_CYCLES, the card renders every sample due up to
+// the current cycle and hands them to the sink. A sample lasts
+// CPU_CLOCK_HZ * speed / AUDIO_SAMPLE_RATE cycles, so the sink always gets
+// AUDIO_SAMPLE_RATE samples per second of host time whatever the --speed
+class ANC216::AudioCard : public ANC216::Device
+{
+private:
+    Audio::Sink *sink;
+    // Emulated cycles per second of host time
+    uint64_t cycles_per_second;
+
+    std::array<AudioChannel, AUDIO_CHANNELS> channels;
+    uint8_t channel = 0;
+    uint8_t dac = 0x80;
+    // Value of the last read operation, returned by cpu_read
+    uint8_t latch = 0;
+
+    // Samples are counted from the cycle origin, the sample n is due at
+    // origin + n * cycles_per_second / AUDIO_SAMPLE_RATE
+    uint64_t origin = 0;
+    uint64_t rendered = 0;
+
+    inline int sample(AudioChannel &);
+    void render(uint64_t);
+    void set_frequency(AudioChannel &, uint16_t);
+    void tick(uint64_t);
+
+public:
+    AudioCard(ANC216::EmemMapper *, EmuFlags, Audio::Sink *);
+    void cpu_write(uint16_t, bool) override;
+    uint16_t cpu_read(uint16_t, bool) override;
+    void save_state(std::vector<uint8_t> &) const override;
+    void load_state(const std::vector<uint8_t> &) override;
+    void schedule_events() override;
+};
@@ -2,12 +2,78 @@
 
 #include <common.hh>
 #include <gpu.hh>
-#include <video.hh>
+#include <display.hh>
+#include <pixels.hh>
+#include <blitter.hh>
+#include <array>
 
+#define W_AVC64_RES 256
+#define H_AVC64_RES 224
+
+// Memory of the card, see doc/avc64.txt
+#define AVC64_TEXTURE_MAP_SIZE 0x2000
+#define AVC64_VRAM_ADDR 0x2000
+#define AVC64_FRAME_CYCLES (CPU_CLOCK_HZ / DEFAULT_REFRESH_RATE)
+
+namespace ANC216
+{
+    // Operation bus, bits 8-11 of the words written to the card
+    enum AVC64Operation
+    {
+        AVC64_SP = 0x00,
+        AVC64_TX = 0x01,
+        AVC64_CL = 0x02,
+        AVC64_CX = 0x03,
+        AVC64_CY = 0x04,
+        AVC64_D1 = 0x05,
+        AVC64_D2 = 0x06,
+        AVC64_D3 = 0x07,
+        AVC64_D4 = 0x08,
+        AVC64_NOP = 0x09,
+        AVC64_FD = 0x0A,
+    };
+}
+
+// The picture is kept as one byte per pixel in the video memory of the
+// card, with a dirty bit per row. Once per frame, on a scheduler event
+// every AVC64_FRAME_CYCLES, the dirty rows are converted through the
+// palette and handed to the display
 class ANC216::AVC64 : public ANC216::VideoCard
 {
+private:
+    std::array<uint8_t, MAX_MEM> memory = {};
+    std::array<uint32_t, 256> palette;
+    std::vector<uint32_t> pixels;
+    bool dirty_rows[H_AVC64_RES];
+    const PixelKernels &kernels;
+    Blitter blitter;
+
+    uint8_t x = 0;
+    uint8_t y = 0;
+    uint8_t d1 = 0;
+    uint8_t d2 = 0;
+    uint8_t d3 = 0;
+    uint8_t d4 = 0;
+    // Value of the last read operation, returned by cpu_read
+    uint8_t latch = 0;
+
+    inline void access(uint8_t &, bool, uint8_t);
+    inline void operate(uint16_t);
+    inline void set_pixel(unsigned, unsigned, uint8_t);
+    void draw_texture();
+    void clear(uint8_t);
+    inline void write_memory(uint8_t);
+    inline uint8_t read_memory();
+    void end_frame(uint64_t);
+
 public:
-    AVC64(ANC216::EmemMapper *, EmuFlags, Video::Window*);
-    void cpu_write(uint16_t, bool);
-    uint16_t cpu_read(uint16_t, bool);
-};
\ No newline at end of file
+    AVC64(ANC216::EmemMapper *, EmuFlags, Video::Display *);
+    void cpu_write(uint16_t, bool) override;
+    uint16_t cpu_read(uint16_t, bool) override;
+    void cpu_write_block(const uint16_t *, size_t, bool) override;
+    void cpu_read_block(uint16_t, uint16_t *, size_t, bool) override;
+    void save_state(std::vector<uint8_t> &) const override;
+    void load_state(const std::vector<uint8_t> &) override;
+    void schedule_events() override;
+    bool batches_transfers() const override;
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pixels.hh>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace ANC216
+{
+    class Blitter;
+
+    // CL field of the texture header
+    enum AVC64TextureMode
+    {
+        AVC64_2_COLORS = 0,
+        AVC64_2_COLORS_1_ALPHA = 1,
+        AVC64_16_COLORS = 2,
+        AVC64_16_COLORS_16_ALPHA = 3,
+        AVC64_256_COLORS = 4,
+        AVC64_256_COLORS_16_ALPHA = 5,
+    };
+}
+
+// Draws the textures of the AVC64 texture map, see doc/avc64.txt. A
+// texture is expanded to one byte per pixel the first time it is drawn and
+// kept until one of the bytes it was decoded from is written
+class ANC216::Blitter
+{
+private:
+    struct Texture
+    {
+        unsigned width;
+        unsigned height;
+        // In the 2 color modes the values are 0 or 1, and colors has them
+        // in the last two colors the texture was drawn with. Text is
+        // usually drawn with the same colors every time
+        bool two_colors;
+        std::vector<uint8_t> colors;
+        int one = -1;
+        int zero = -1;
+        // Without any transparent pixel the mask is left empty
+        bool opaque;
+        std::vector<uint8_t> values;
+        std::vector<uint8_t> mask;
+    };
+
+    static constexpr int32_t NO_TEXTURE = -1;
+
+    const uint8_t *map;
+    size_t size;
+    const PixelKernels &kernels;
+
+    // Where the header of every texture is, and which texture every byte
+    // of the map is part of. Bytes of headers and after the last texture
+    // are NO_TEXTURE, writing them changes the layout of the map
+    bool indexed = false;
+    std::unordered_map<uint16_t, size_t> headers;
+    std::vector<int32_t> owners;
+    std::unordered_map<uint16_t, Texture> textures;
+
+    void index();
+    void decode(size_t, Texture &);
+
+public:
+    Blitter(const uint8_t *, size_t);
+    ~Blitter() = default;
+
+    void written(size_t);
+    void invalidate();
+    unsigned draw(uint16_t, unsigned, unsigned, uint8_t, uint8_t, uint8_t *, unsigned, unsigned);
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <common.hh>
+#include <decoder.hh>
+#include <memory>
+#include <vector>
+
+#define MAX_BLOCK_LENGTH 64
+
+struct ANC216::BlockInstruction
+{
+    DecodedInstruction ins;
+    // Fetch and handler of this opcode and addressing mode in one function,
+    // see CPU::block_step
+    BlockStep step;
+    uint16_t next_pc;
+    // Operands relative to pc are resolved when translating
+    uint16_t address;
+};
+
+// A straight run of instructions ending at the first one that can change pc
+struct ANC216::Block
+{
+    std::vector<BlockInstruction> code;
+    // Of all its instructions, a block ending before the end of the run
+    // doesn't check it after each one
+    uint64_t cycles = 0;
+    // Pages holding its code, at most 2 per instruction
+    std::vector<uint8_t> pages;
+    bool valid = true;
+};
+
+class ANC216::BlockEngine
+{
+private:
+    CPU &cpu;
+    std::vector<std::unique_ptr<Block>> blocks = std::vector<std::unique_ptr<Block>>(MAX_MEM);
+    std::vector<uint16_t> page_blocks[PAGES];
+
+    void add_page(Block *, uint16_t, uint8_t);
+    Block *translate(uint16_t);
+    template <bool>
+    void execute(const Block &);
+
+public:
+    BlockEngine(CPU &);
+    void run();
+    void invalidate_page(uint8_t);
+    void flush();
+};
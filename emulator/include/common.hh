@@ -2,11 +2,15 @@
 
 // -- DEFINES
 #define MAX_MEM 65'536
+#define PAGE_SIZE 256
+#define PAGES (MAX_MEM / PAGE_SIZE)
 
 #define DEFAULT_VIDEO_CARD_ADDR 0xFFFD
 #define DEFAULT_AUDIO_CARD_ADDR 0xFFFE
 #define ROM_ADDR 0xFF00
 
+#define CPU_CLOCK_HZ 1'000'000
+
 #include <types.hh>
 
 namespace ANC216
@@ -23,9 +27,23 @@ namespace ANC216
     class Device;
     class EmemMapper;
     class CPU;
+    class BlockEngine;
+    struct Block;
+    struct BlockInstruction;
+    class Scheduler;
+    class Timer;
+    struct Snapshot;
+    class History;
+    class Debugger;
+    class Tracer;
+    class Profiler;
+    class Machine;
+    class Runner;
     class VideoCard;
     class AVC64;
+    class AudioCard;
     struct CPUInfo;
+    struct BusResponse;
 }
 
 #include <emem.hh>
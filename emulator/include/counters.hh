@@ -0,0 +1,85 @@
+#pragma once
+
+#include <isa.hh>
+#include <cstdint>
+#include <ostream>
+
+// Built in with -DANC216_STATS=ON, see CMakeLists.txt. Included by cpu.hh,
+// so it relies on common.hh for MAX_MEM
+#ifndef ANC216_STATS
+#define ANC216_STATS 0
+#endif
+
+#define STATS_REGION_SIZE 4096
+#define STATS_REGIONS (MAX_MEM / STATS_REGION_SIZE)
+
+namespace ANC216
+{
+    enum BusTransaction
+    {
+        BUS_INFO_REQUEST,
+        BUS_REQUEST,
+        BUS_WRITE,
+        BUS_READ,
+        BUS_RESPONSE,
+        BUS_TRANSACTIONS,
+    };
+
+    template <bool Enabled>
+    struct Counters;
+
+    // Without statistics every hook is empty, so the calls in the CPU
+    // compile to nothing
+    template <>
+    struct Counters<false>
+    {
+        static constexpr bool enabled = false;
+
+        inline void instruction(uint8_t, AddressingMode) {}
+        inline void branch(uint8_t, bool) {}
+        inline void read(uint16_t) {}
+        inline void write(uint16_t) {}
+        inline void bus(BusTransaction) {}
+        inline void clear() {}
+        void write_json(std::ostream &) const;
+    };
+
+    // Execution counters of one CPU. Only the thread running the CPU
+    // writes them, the block starts on its own cache line so that CPUs
+    // running on other threads never share a line with it
+    template <>
+    struct alignas(64) Counters<true>
+    {
+        static constexpr bool enabled = true;
+
+        uint64_t opcodes[256];
+        uint64_t modes[NONE + 1];
+        uint64_t taken[256];
+        uint64_t not_taken[256];
+        uint64_t reads[STATS_REGIONS];
+        uint64_t writes[STATS_REGIONS];
+        uint64_t transactions[BUS_TRANSACTIONS];
+
+        Counters() { clear(); }
+
+        inline void instruction(uint8_t opcode, AddressingMode mode)
+        {
+            opcodes[opcode]++;
+            modes[mode]++;
+        }
+
+        inline void branch(uint8_t opcode, bool was_taken)
+        {
+            (was_taken ? taken : not_taken)[opcode]++;
+        }
+
+        inline void read(uint16_t address) { reads[address / STATS_REGION_SIZE]++; }
+        inline void write(uint16_t address) { writes[address / STATS_REGION_SIZE]++; }
+        inline void bus(BusTransaction transaction) { transactions[transaction]++; }
+
+        void clear();
+        void write_json(std::ostream &) const;
+    };
+
+    typedef Counters<ANC216_STATS> Statistics;
+}
@@ -2,12 +2,23 @@
 
 #include <common.hh>
 #include <isa.hh>
+#include <decoder.hh>
+#include <seqlock.hh>
+#include <scheduler.hh>
+#include <timer.hh>
+#include <counters.hh>
+#include <array>
 #include <thread>
+#include <atomic>
+#include <iostream>
+#include <vector>
 #include <chrono>
+#include <mutex>
+#include <memory>
 
 struct ANC216::CPUInfo
 {
-    int16_t *reg;
+    int16_t reg[8];
 
     uint8_t sr;
     uint16_t sp;
@@ -15,6 +26,9 @@ struct ANC216::CPUInfo
 
     uint16_t pc;
     uint16_t current_instruction;
+
+    uint64_t cycles;
+    uint64_t instructions;
 };
 
 class ANC216::CPU
@@ -23,46 +37,178 @@ private:
     int16_t reg[8] = {0};
 
     uint8_t sr;
-    uint16_t sp;
-    uint16_t bp;
+    uint16_t sp = 0;
+    uint16_t bp = 0;
 
     uint16_t pc;
     uint16_t current_instruction;
 
-    AddressingMode current_addressing_mode;
-    uint8_t argsize;
-    uint16_t arg;
+    // Lazy condition codes: the last result that sets N and Z, and the
+    // operation and operands that set O and C. They are only folded into
+    // sr when something reads it
+    uint16_t flags_result = 0;
+    uint8_t flags_size = 0;
+    uint8_t flags_op = 0;
+    uint16_t flags_a = 0;
+    uint16_t flags_b = 0;
+
+    uint16_t mtu[6] = {0};
+    uint16_t cpid = 0;
 
-    uint8_t *imem = new uint8_t[MAX_MEM];
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t slice_end = 0;
+    uint64_t run_end = 0;
+
+    uint8_t *imem = new uint8_t[MAX_MEM]();
+    // Pages as of the last snapshot, and the ones written since
+    std::array<std::shared_ptr<const std::array<uint8_t, PAGE_SIZE>>, PAGES> snapshot_pages;
+    bool dirty_pages[PAGES];
+    DecodedInstruction *decode_cache = new DecodedInstruction[MAX_MEM]();
     EmemMapper *emem;
-    std::thread *thread;
+    std::thread *thread = nullptr;
+    std::ostream *out = &std::cout;
+    std::ostream *err = &std::cerr;
+
+    BlockEngine *blocks = nullptr;
+    History *history = nullptr;
+    Debugger *debugger = nullptr;
+    Tracer *tracer = nullptr;
+    Profiler *profiler = nullptr;
+    bool watched_pages[PAGES] = {false};
+    bool code_pages[PAGES] = {false};
+    bool exit_block = false;
+
+    Scheduler scheduler;
+    Timer timer;
+    Statistics counters;
 
-    bool killed = false;
-    bool running;
+    // One bit per interrupt source. Device threads set bits, the CPU thread
+    // delivers them between runs of straight-line code
+    std::atomic<uint8_t> pending_interrupts = 0;
+    uint8_t nmi_code = 0;
+
+    std::atomic<bool> killed = false;
+    std::atomic<bool> running;
+    bool out_of_budget = false;
+    Seqlock<CPUInfo> snapshot;
+    // Held by the CPU thread while it runs a slice, snapshots wait on it
+    std::mutex state_mutex;
     const EmuFlags &flags;
 
-    inline int8_t get_lower(int16_t);
-    inline void fetch_instruction();
-    inline void get_addressing_mode();
-    inline void store_data();
-    inline void load_reg(uint16_t);
-    inline std::pair<uint8_t, uint16_t> fetch_data();
+    static const std::array<AddressingInfo, 256> addressing_table;
+    static const std::array<Handler, 256> handlers;
+
+    static constexpr AddressingInfo decode_addressing(uint8_t);
+    template <AddressingMode>
+    static void fetch(CPU &, const DecodedInstruction &, Operand &);
+    template <uint8_t>
+    static void exec(CPU &, const DecodedInstruction &, const Operand &);
+    template <uint8_t, AddressingMode>
+    static void block_step(CPU &, const BlockInstruction &);
+    static const std::array<BlockStep, 256 * (NONE + 1)> block_steps;
+
+    inline uint8_t read_byte(uint16_t);
+    inline uint16_t read_word(uint16_t);
+    inline void write_byte(uint16_t, uint8_t);
+    inline void write_word(uint16_t, uint16_t);
+    inline void push_byte(uint8_t);
+    inline void push_word(uint16_t);
+    inline uint8_t pop_byte();
+    inline uint16_t pop_word();
+    inline void invalidate(uint16_t);
+    inline uint16_t store_value(const DecodedInstruction &, const Operand &);
+    inline uint16_t load_value(const Operand &);
+    inline void set_register(uint8_t, uint16_t, uint8_t);
+    inline void set_nz(uint16_t, uint8_t);
+    inline void set_arithmetic(uint8_t, uint16_t, uint16_t, uint16_t, uint8_t);
+    inline void materialize_flags();
+    inline uint8_t get_sr();
+    inline void set_sr(uint8_t);
+    inline bool flag_n();
+    inline bool flag_z();
+    inline bool flag_o();
+    inline bool flag_c();
+    void flush_decode_cache();
+    void decode(uint16_t, DecodedInstruction &);
     inline void execute();
-    inline void nmi();
+    inline void count(const DecodedInstruction &, uint16_t);
+    void replay_instruction();
+    inline void run_slice();
+    inline void run_checked();
+    inline void run_instrumented();
+    inline void instrumented_execute();
+    inline void end_slice();
+    inline void sync_events();
+    void timer_expired();
+    void publish();
+    inline void host_syscall();
+    inline void nmi(uint8_t);
+    inline void interrupt(uint8_t);
+    inline void enter_interrupt(uint16_t);
+    inline void leave_interrupt();
+    void service_interrupts();
+    void take_interrupt(uint8_t, const BusResponse &);
+    inline uint16_t bus_read(uint16_t, bool);
+    Snapshot capture();
+    void restore(const Snapshot &);
 
+    friend class BlockEngine;
+    friend class History;
+    friend class Debugger;
+    friend class Tracer;
+    friend class Profiler;
 
 public:
     CPU(EmemMapper*, const EmuFlags&);
     ~CPU();
     inline void load_init_state();
+    void launch();
+    void run();
     void start();
     void stop();
+    void load_memory(uint16_t, const std::vector<uint8_t> &);
+    bool budget_exceeded();
     uint16_t get_pc();
     uint16_t get_current_instruction();
+    uint64_t get_cycles();
+    uint64_t get_instructions();
     int16_t *get_registers();
     inline void _cycle();
-    inline void einr();
+    void run_for(uint64_t);
+    bool is_killed();
+    void set_output(std::ostream *, std::ostream *);
+    EventId schedule_event(uint64_t, EventAction);
+    void cancel_event(EventId);
+    void einr();
     void wait();
     CPUInfo get_info();
+    void set_state(const CPUInfo &);
+    Snapshot take_snapshot();
+    void restore_snapshot(const Snapshot &);
+    History *get_history();
+    Debugger *get_debugger();
+    bool is_running();
+    std::vector<uint8_t> read_memory(uint16_t, uint16_t);
+    void start_trace(const std::string &);
+    void flush_trace();
+    void start_profile(const std::string &, uint64_t, const std::string &);
+    void write_profile();
+    void write_statistics(std::ostream &);
     void step();
-};
\ No newline at end of file
+    static const AddressingInfo &addressing(uint8_t);
+};
+
+// Statistics of the instruction that just ran, next_pc is where it would
+// have continued without jumping. Here and not in cpu.cc because the block
+// engine counts too, nothing is left of it without ANC216_STATS
+inline void ANC216::CPU::count(const DecodedInstruction &ins, uint16_t next_pc)
+{
+    if constexpr (Statistics::enabled)
+    {
+        uint8_t opcode = ins.instruction & 0xFF;
+        counters.instruction(opcode, ins.mode);
+        if (opcode >= JMP && opcode <= JNN)
+            counters.branch(opcode, pc != next_pc);
+    }
+}
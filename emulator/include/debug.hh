@@ -7,4 +7,4 @@
 
 void debug_console(ANC216::CPU&, ANC216::EmemMapper&, ANC216::Video::Window&);
 void print_debug_help();
-void show_cpu_info(ANC216::CPUInfo);
\ No newline at end of file
+void show_cpu_info(const ANC216::CPUInfo &, std::vector<std::string> &);
\ No newline at end of file
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <common.hh>
+#include <map>
+#include <ostream>
+
+#define NO_PC UINT32_MAX
+
+namespace ANC216
+{
+    enum StopMode
+    {
+        STOP_NONE,
+        STOP_AFTER_JUMP,
+        STOP_AFTER_RETURN,
+    };
+}
+
+// Breakpoints and watchpoints of the debug console. Breakpoints are one
+// bit per address and watchpoints set a flag on the pages they cover, so
+// the CPU checks each of them with a single test. The checks only run
+// while something is set. The public methods that change them take the
+// state lock of the CPU, the checks run with it already held
+class ANC216::Debugger
+{
+private:
+    enum PointType
+    {
+        BREAKPOINT,
+        WATCHPOINT,
+    };
+
+    struct Point
+    {
+        PointType type;
+        uint16_t address;
+        uint16_t size;
+    };
+
+    CPU &cpu;
+    uint64_t breakpoints[MAX_MEM / 64] = {0};
+    std::map<unsigned, Point> points;
+    unsigned next_id = 1;
+
+    StopMode mode = STOP_NONE;
+    // A run started on a breakpoint doesn't stop there again right away
+    uint32_t resume_pc = NO_PC;
+
+    bool hit = false;
+    unsigned hit_id = 0;
+    uint16_t hit_address = 0;
+
+    void update();
+
+public:
+    Debugger(CPU &);
+
+    inline bool is_breakpoint(uint16_t address)
+    {
+        return breakpoints[address / 64] >> (address % 64) & 1;
+    }
+
+    inline bool active()
+    {
+        return !points.empty() || mode != STOP_NONE;
+    }
+
+    unsigned add_breakpoint(uint16_t);
+    unsigned add_watchpoint(uint16_t, uint16_t);
+    bool remove(unsigned);
+    void remove_all();
+    void list(std::ostream &);
+
+    void set_mode(StopMode);
+    uint32_t take_resume_pc();
+    void clear_resume_pc();
+    bool should_stop(uint16_t, uint32_t);
+    bool should_stop_after(uint8_t);
+    void check_write(uint16_t);
+    bool stop_requested();
+    bool report(std::ostream &);
+    void clear_hit();
+};
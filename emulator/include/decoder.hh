@@ -0,0 +1,51 @@
+#pragma once
+
+#include <common.hh>
+#include <isa.hh>
+
+namespace ANC216
+{
+    struct DecodedInstruction;
+
+    struct Operand
+    {
+        uint16_t value;
+        uint16_t address;
+        uint8_t size;
+        bool memory;
+    };
+
+    typedef void (*FetchRoutine)(CPU &, const DecodedInstruction &, Operand &);
+    typedef void (*Handler)(CPU &, const DecodedInstruction &, const Operand &);
+    typedef void (*BlockStep)(CPU &, const BlockInstruction &);
+
+    // One entry per addressing byte: mode, argument layout, register fields
+    // and the routine that resolves the operand
+    struct AddressingInfo
+    {
+        AddressingMode mode;
+        uint8_t argsize;
+        uint8_t immsize;
+        uint8_t x1;
+        uint8_t x2;
+        FetchRoutine fetch;
+    };
+
+    // An instruction decoded once and kept in the CPU decode cache until the
+    // memory it was read from is written
+    struct DecodedInstruction
+    {
+        Handler handler;
+        FetchRoutine fetch;
+        uint16_t arg;
+        uint16_t arg2;
+        uint16_t instruction;
+        AddressingMode mode;
+        uint8_t immsize;
+        uint8_t x1;
+        uint8_t x2;
+        uint8_t length;
+        uint8_t cycles;
+        bool valid;
+    };
+}
@@ -9,13 +9,56 @@ protected:
     EmemMapper *emem;
     EmuFlags flags;
 
-    inline uint16_t get_addr() const;
+    uint16_t get_addr() const;
 
 public:
     Device(EmemMapper *emem, EmuFlags flags);
+    virtual ~Device() = default;
 
     virtual void cpu_write(uint16_t value, bool additional_flag) = 0;
     virtual uint16_t cpu_read(uint16_t value, bool additional_flag) = 0;
 
-    inline DeviceID cpu_info_req();
+    // Bulk transfers of the batches collected by the mapper, devices that
+    // can take or fill a whole buffer at once should override these. Reads
+    // get the offset of the address in the device, like cpu_read
+    virtual void cpu_write_block(const uint16_t *values, size_t count, bool additional_flag)
+    {
+        for (size_t i = 0; i < count; i++)
+            cpu_write(values[i], additional_flag);
+    }
+
+    virtual void cpu_read_block(uint16_t offset, uint16_t *values, size_t count, bool additional_flag)
+    {
+        for (size_t i = 0; i < count; i++)
+            values[i] = cpu_read(offset, additional_flag);
+    }
+
+    // Devices that don't care at which cycle a write or a request arrives
+    // can let the mapper collect consecutive ones to the same address and
+    // take them in one cpu_write_block or cpu_read_block. They get them
+    // before any read and before any scheduled event
+    virtual bool batches_transfers() const
+    {
+        return false;
+    }
+
+    // Internal state for snapshots, devices without any can keep these
+    virtual void save_state(std::vector<uint8_t> &state) const
+    {
+    }
+
+    virtual void load_state(const std::vector<uint8_t> &state)
+    {
+    }
+
+    // Devices driven by emulated time schedule their next event here. Also
+    // called after the CPU dropped the events, see EmemMapper::schedule_events
+    virtual void schedule_events()
+    {
+    }
+
+    inline DeviceID cpu_info_req()
+    {
+        return this->id;
+    }
 };
\ No newline at end of file
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <types.hh>
+#include <vector>
+#include <stdint.h>
+
+#define DEFAULT_REFRESH_RATE 60
+
+namespace ANC216::Video
+{
+    // A full picture in ARGB8888, ready to be shown
+    struct Frame
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint32_t> pixels;
+    };
+
+    // Where a video card sends its picture: the SDL window (video.hh) or
+    // memory (offscreen.hh). All the calls come from the CPU thread
+    class Display
+    {
+    public:
+        virtual ~Display() = default;
+
+        // Called once by the card with its resolution
+        virtual void open(int width, int height, const EmuFlags &flags) = 0;
+        // Replaces count rows of the picture starting from row with pixels
+        // in ARGB8888
+        virtual void update_rows(int width, int height, int row, int count, const uint32_t *pixels) = 0;
+        // The card finished a frame
+        virtual void end_frame()
+        {
+        }
+        // The guest asked to save the current frame
+        virtual void capture()
+        {
+        }
+    };
+}
@@ -1,20 +1,90 @@
 #pragma once
 
 #include <common.hh>
-#include <video.hh>
+#include <scheduler.hh>
+#include <memory>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <vector>
 
+#define MAX_BATCH_SIZE 256
+
+namespace ANC216
+{
+    // Value of L2 when the EINR handler is called
+    enum BusRequest
+    {
+        READ_REQUEST = 0,
+        HIGH_READ_REQUEST = 1,
+        INFO_REQUEST = 2,
+        DEVICE_REQUEST = 3,
+    };
+
+    struct BusResponse
+    {
+        uint16_t address;
+        uint16_t data;
+        BusRequest type;
+    };
+}
+
+// Devices are found through a table of 256 byte pages. The table of a page
+// is only allocated once a device is mapped in it
 class ANC216::EmemMapper
 {
 private:
-    std::pair<uint8_t, Device *> *emem = new std::pair<uint8_t, Device *>[MAX_MEM];
+    struct Page
+    {
+        Device *devices[PAGE_SIZE] = {nullptr};
+    };
+
+    std::unique_ptr<Page> pages[PAGES];
+    std::unordered_map<const Device *, uint16_t> bases;
+    std::vector<Device *> devices;
     CPU *cpu;
 
+    // Consecutive writes, or requests, to the same address of a device that
+    // batches transfers are collected here and handed to it in one call.
+    // For requests batch gets the data read
+    Device *batch_device = nullptr;
+    uint16_t batch_address;
+    bool batch_flag;
+    bool batch_writes;
+    BusRequest batch_type;
+    std::vector<uint16_t> batch;
+
+    std::mutex responses_mutex;
+    std::deque<BusResponse> responses;
+
+    void batch_to(Device *, uint16_t, bool, bool, BusRequest);
+
 public:
-    EmemMapper(const EmuFlags &, Video::Window*);
+    EmemMapper(const EmuFlags &);
     ~EmemMapper();
     void set_cpu(CPU *);
-    uint16_t where_am_i(const Device *);
-    void write(uint16_t, uint16_t);
-    void read(uint16_t, uint16_t);
-    void info_req(uint16_t);
-};
\ No newline at end of file
+    void map(uint16_t, Device *, uint16_t size = 1);
+    inline Device *device_at(uint16_t address)
+    {
+        Page *page = pages[address / PAGE_SIZE].get();
+        return page != nullptr ? page->devices[address % PAGE_SIZE] : nullptr;
+    }
+    inline uint16_t where_am_i(const Device *device)
+    {
+        auto base = bases.find(device);
+        return base != bases.end() ? base->second : 0;
+    }
+    void write(uint16_t value, uint16_t address, bool additional_flag);
+    uint16_t read(uint16_t address, bool additional_flag);
+    void request(uint16_t address, bool additional_flag, bool high);
+    void info_req(uint16_t address);
+    void flush();
+    void respond(uint16_t address, uint16_t data, BusRequest type);
+    bool next_response(BusResponse &);
+    void save_state(Snapshot &);
+    void load_state(const Snapshot &);
+    uint64_t get_cycles();
+    EventId schedule(uint64_t, EventAction);
+    void cancel(EventId);
+    void schedule_events();
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace ANC216
+{
+    // XXH64 of size bytes, the same value the reference xxHash library
+    // gives, so hashes can be checked with xxhsum
+    uint64_t xxh64(const void *data, size_t size, uint64_t seed = 0);
+}
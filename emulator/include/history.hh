@@ -0,0 +1,73 @@
+#pragma once
+
+#include <common.hh>
+#include <snapshot.hh>
+#include <deque>
+#include <ostream>
+#include <functional>
+
+// Execution history for the debug console. Checkpoints of the CPU are
+// taken every interval instructions and everything the machine got from
+// outside in between (bus reads and the interrupts taken) is logged, so any
+// point after the oldest checkpoint is rebuilt by replaying from the
+// checkpoint before it
+class ANC216::History
+{
+private:
+    enum EventType
+    {
+        INTERRUPT_EVENT,
+        READ_EVENT,
+    };
+
+    struct Event
+    {
+        uint64_t instruction;
+        uint8_t type;
+        uint8_t source;
+        BusResponse response;
+    };
+
+    struct Checkpoint
+    {
+        Snapshot state;
+        uint64_t event;
+    };
+
+    CPU &cpu;
+    size_t size;
+    uint64_t interval;
+
+    std::deque<Checkpoint> checkpoints;
+    std::deque<Event> events;
+    // Index of the first event kept, events are numbered from the start of
+    // the recording
+    uint64_t first_event = 0;
+    uint64_t cursor = 0;
+
+    // Set after going back: the recording goes on to newest, until the
+    // machine runs again and the future is dropped
+    bool rewound = false;
+    uint64_t newest = 0;
+
+    bool replaying = false;
+    EmemMapper detached;
+    std::ostream discard{nullptr};
+
+    void truncate();
+    void checkpoint();
+    void replay(const Checkpoint &, uint64_t, const std::function<void()> &);
+    std::deque<Checkpoint>::iterator checkpoint_before(uint64_t);
+    void begin_rewind();
+
+public:
+    History(CPU &, size_t, uint64_t);
+    void record();
+    void log_interrupt(uint8_t, const BusResponse &);
+    uint16_t read(uint16_t, bool);
+    void go_to(uint64_t);
+    void reverse_continue();
+    uint64_t oldest();
+    uint64_t latest();
+    void clear();
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 #include <tuple>
+#include <stdint.h>
 
 
 namespace ANC216
@@ -152,4 +153,136 @@ namespace ANC216
         TSTOP = 0x62,
         TRT = 0x63,
     };
-}
\ No newline at end of file
+
+    enum Syscall
+    {
+        SYSCALL_EXIT = 0x00,
+        SYSCALL_PRINT = 0x05,
+    };
+
+    // Reason of a non maskable interrupt, passed to the handler in R0
+    enum NmiCode
+    {
+        NMI_BAD_OPCODE = 0x00,
+        NMI_PRIVILEGES = 0x01,
+        NMI_IMEM = 0x02,
+        NMI_EMEM = 0x03,
+        NMI_STACK = 0x04,
+        NMI_SOFT_RESET = 0x05,
+    };
+
+    // Cycle costs. The ANC216 specification doesn't give any timing, so these
+    // are placeholders of the emulator and not ISA behaviour: 1 cycle for
+    // flag changes, 2 for ALU and data moves, 3 for stack and special
+    // registers, 4 for the bus, 5 for calls and 8 to enter an interrupt
+    // handler. Everything paced in emulated time (--speed, the timer, the
+    // scheduler, video frames and audio pitch) depends on them, change them
+    // here only
+    //
+    // Base cost in clock cycles of each instruction, without the cost of its
+    // addressing mode
+    constexpr uint8_t instruction_cycles(uint8_t opcode)
+    {
+        switch (opcode)
+        {
+        case KILL:
+        case SETI:
+        case SETT:
+        case SETS:
+        case CLRI:
+        case CLRT:
+        case CLRS:
+        case CLRN:
+        case CLRO:
+        case CLRC:
+        case PAREQ:
+        case CAREQ:
+            return 1;
+        case PUSH:
+        case POP:
+        case PHPC:
+        case POPC:
+        case PHSR:
+        case POSR:
+        case PHSP:
+        case POSP:
+        case PHBP:
+        case POBP:
+        case SWAP:
+        case SILI:
+        case SIHI:
+        case SELI:
+        case SEHI:
+        case SBP:
+        case STP:
+        case TILI:
+        case TIHI:
+        case TELI:
+        case TEHI:
+        case TBP:
+        case TTP:
+        case LCPID:
+        case TCPID:
+            return 3;
+        case IREQ:
+        case REQ:
+        case WRITE:
+        case HREQ:
+        case HWRITE:
+        case READ:
+            return 4;
+        case CALL:
+        case RET:
+            return 5;
+        case SYSCALL:
+            return 6;
+        case RESETI:
+            return 8;
+        default:
+            return 2;
+        }
+    }
+
+    // Cost of entering an interrupt handler: saving SP, switching to the
+    // system stack, pushing the frame and reading the vector
+    constexpr uint8_t interrupt_cycles = 8;
+
+    // Extra cycles spent accessing memory, on top of one cycle for each
+    // argument byte
+    constexpr uint8_t addressing_cycles(AddressingMode mode)
+    {
+        switch (mode)
+        {
+        case MEMORY_ABSOULTE:
+        case MEMORY_RELATIVE_TO_PC:
+        case MEMORY_RELATIVE_TO_BP:
+        case IMMEDIATE_TO_MEMORY_ABSOLUTE:
+        case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP:
+        case REGISTER_TO_MEMORY_ABSOULTE:
+        case MEMORY_ABSOULTE_TO_REGISTER:
+        case REGISTER_TO_MEMORY_RELATIVE_TO_PC:
+        case MEMORY_RELATIVE_TO_PC_TO_REGISTER:
+        case REGISTER_TO_MEMORY_RELATIVE_TO_BP:
+        case MEMORY_RELATIVE_TO_BP_TO_REGISTER:
+        case LOW_REGISTER_TO_MEMORY_ABSOLUTE:
+        case MEMORY_ABSOULTE_TO_LOW_REGISTER:
+        case LOW_REGISTER_TO_MEMORY_RELATIVE_TO_PC:
+        case MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER:
+        case LOW_REGISTER_TO_MEMORY_RELATIVE_TO_BP:
+        case MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER:
+            return 1;
+        case MEMORY_ABSOULTE_INDEXED:
+        case MEMORY_RELATIVE_TO_PC_WITH_REGISTER:
+        case MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
+        case IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED:
+        case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
+            return 2;
+        case MEMORY_INDIRECT:
+            return 3;
+        case MEMORY_INDIRECT_INDEXED:
+            return 4;
+        default:
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <common.hh>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace ANC216
+{
+    struct MachineResult
+    {
+        uint16_t exit_code = 0;
+        bool out_of_budget = false;
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        // What the guest printed to stdout and stderr
+        std::string output;
+        std::string errors;
+    };
+
+    void load_boot_image(CPU &, std::vector<uint8_t>);
+}
+
+// A headless computer without a thread of its own: whoever owns it runs it
+// one slice at a time with run(). The guest output is kept in memory.
+// Machines share nothing, so different machines can run on different
+// threads at the same time
+class ANC216::Machine
+{
+private:
+    // Declared first, the mapper and the CPU keep a reference to it
+    EmuFlags flags;
+    EmemMapper mapper;
+    CPU cpu;
+    std::ostringstream out;
+    std::ostringstream err;
+
+public:
+    Machine(const EmuFlags &);
+    ~Machine() = default;
+
+    void load_memory(uint16_t, const std::vector<uint8_t> &);
+    std::vector<uint8_t> read_memory(uint16_t, uint16_t);
+    void load_boot_image(const std::vector<uint8_t> &);
+    void load_boot_file(const std::string &);
+    void map(uint16_t, Device *, uint16_t size = 1);
+    bool run(uint64_t);
+    bool finished();
+    CPUInfo get_state();
+    void set_state(const CPUInfo &);
+    MachineResult result();
+    CPU &get_cpu();
+    EmemMapper *get_mapper();
+    const EmuFlags &get_flags();
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <display.hh>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ANC216::Video
+{
+    enum FrameFormat
+    {
+        FRAME_PPM,
+        FRAME_PNG,
+        // Every frame appended to a single file as RGB24, width * height * 3
+        // bytes each
+        FRAME_RAW,
+    };
+
+    // Display that keeps the picture in memory, for running without SDL.
+    // Frames are dumped every interval frames and when the guest asks for
+    // a capture. With a hash file every frame writes a line with its
+    // number and the XXH64 of its RGB24 pixels, so a test can compare a
+    // run against golden hashes without writing any image
+    class Offscreen : public Display
+    {
+    private:
+        std::string path;
+        FrameFormat format;
+        uint64_t interval;
+        std::string hashfile;
+
+        Frame frame;
+        std::vector<uint8_t> rgb;
+        bool rgb_valid = false;
+        uint64_t hash = 0;
+        bool hash_valid = false;
+        uint64_t frames = 0;
+        bool capture_requested = false;
+
+        std::ofstream raw;
+        std::ofstream hashes;
+        // After a write error nothing else is written
+        bool failed = false;
+
+        const std::vector<uint8_t> &to_rgb();
+        void dump();
+        void write_image(const std::string &);
+        void fail(const std::string &);
+
+    public:
+        // An empty path doesn't dump any frame, an interval of 0 only dumps
+        // the frames captured by the guest
+        Offscreen(const std::string &path = "", FrameFormat format = FRAME_PPM, uint64_t interval = 0, const std::string &hashfile = "");
+        ~Offscreen() = default;
+
+        void open(int width, int height, const EmuFlags &flags) override;
+        void update_rows(int width, int height, int row, int count, const uint32_t *pixels) override;
+        void end_frame() override;
+        void capture() override;
+
+        // XXH64 of the RGB24 pixels of the current picture
+        uint64_t get_hash();
+        const Frame &get_frame() const;
+        // Frames ended since the display was opened
+        uint64_t get_frames() const;
+    };
+}
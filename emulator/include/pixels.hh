@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define ANC216_X86 1
+#else
+#define ANC216_X86 0
+#endif
+
+namespace ANC216
+{
+    // Data parallel loops of the video cards. There is a set for SSE2, one
+    // for AVX2 and a scalar one for the other hosts, pixel_kernels()
+    // returns the best one the host supports
+    struct PixelKernels
+    {
+        const char *name;
+
+        // out[i] = palette[in[i]]
+        void (*palette)(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette);
+        void (*fill)(uint8_t *out, uint8_t value, size_t count);
+        // Splits count pixels of bits bits each (1, 2, 4 or 8), packed from
+        // the most significant bit, into one byte per pixel
+        void (*unpack)(const uint8_t *in, uint8_t *out, size_t count, int bits);
+        // out[i] = in[i] != 0 ? one : zero
+        void (*select)(const uint8_t *in, uint8_t *out, size_t count, uint8_t one, uint8_t zero);
+        // Copies the pixels whose mask byte is 0xFF, the mask is 0x00 or 0xFF
+        void (*masked_copy)(const uint8_t *in, const uint8_t *mask, uint8_t *out, size_t count);
+    };
+
+    const PixelKernels &pixel_kernels();
+    // Every set the host can run, the scalar one first. The tests check the
+    // others against it
+    std::vector<const PixelKernels *> supported_pixel_kernels();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <common.hh>
+#include <map>
+#include <string>
+#include <vector>
+
+// Sampling profiler for --profile. The call stack of the guest is tracked
+// through CALL/RET and PHPC/POPC, and every interval emulated cycles the
+// routines on it and the current pc are charged with the cycles since the
+// previous sample. The result is written as collapsed stacks, one line
+// per stack with the frames separated by ';' and the cycles, which
+// flame graph tools read directly
+class ANC216::Profiler
+{
+private:
+    static constexpr size_t MAX_DEPTH = 256;
+
+    CPU &cpu;
+    std::string filename;
+    uint64_t interval;
+    uint64_t next_sample;
+    uint64_t last_sample;
+
+    // Entry address of every routine being run, the innermost last. Calls
+    // deeper than MAX_DEPTH are only counted
+    std::vector<uint16_t> stack;
+    size_t hidden = 0;
+    // PHPC opens a frame whose entry is the target of the next jump
+    bool pending_entry = false;
+
+    std::map<std::vector<uint16_t>, uint64_t> samples;
+    std::vector<uint16_t> key;
+    std::map<uint16_t, std::string> symbols;
+
+    void push(uint16_t);
+    void pop();
+    void sample();
+    std::string name(uint16_t);
+
+public:
+    Profiler(CPU &, const std::string &, uint64_t);
+    ~Profiler() = default;
+
+    void load_symbols(const std::string &);
+    void after_instruction(uint8_t, bool);
+    void enter_interrupt();
+    void clear_stack();
+    void write();
+};
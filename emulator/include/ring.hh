@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <type_traits>
+
+namespace ANC216
+{
+    // Lock free queue between one producer thread and one consumer thread.
+    // Neither side ever waits: push drops what doesn't fit and pop returns
+    // what there is. Size must be a power of two
+    template <typename T, size_t Size>
+    class Ring
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+        static_assert(Size != 0 && (Size & (Size - 1)) == 0);
+
+    private:
+        // Each index is written by one side only, on its own cache line
+        alignas(64) std::atomic<size_t> head = 0;
+        alignas(64) std::atomic<size_t> tail = 0;
+        alignas(64) T data[Size];
+
+    public:
+        // Producer side, returns how many values were queued
+        size_t push(const T *values, size_t count)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t free = Size - (t - head.load(std::memory_order_acquire));
+            if (count > free)
+                count = free;
+            for (size_t i = 0; i < count; i++)
+                data[(t + i) & (Size - 1)] = values[i];
+            tail.store(t + count, std::memory_order_release);
+            return count;
+        }
+
+        // Consumer side, returns how many values were taken
+        size_t pop(T *values, size_t count)
+        {
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t used = tail.load(std::memory_order_acquire) - h;
+            if (count > used)
+                count = used;
+            for (size_t i = 0; i < count; i++)
+                values[i] = data[(h + i) & (Size - 1)];
+            head.store(h + count, std::memory_order_release);
+            return count;
+        }
+
+        size_t size() const
+        {
+            return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+        }
+    };
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <machine.hh>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Each worker keeps at most this many machines started, so only
+// threads * MACHINES_PER_WORKER machines are in memory at once
+#define MACHINES_PER_WORKER 4
+
+// Runs many independent machines to completion on a pool of threads.
+// Machines are created when a worker gets to them and run one slice at a
+// time, round robin with the other machines of the same worker. A worker
+// without machines left takes one from the back of another worker's queue
+class ANC216::Runner
+{
+public:
+    typedef std::function<std::unique_ptr<Machine>()> Factory;
+
+private:
+    struct Task
+    {
+        size_t job;
+        std::unique_ptr<Machine> machine;
+    };
+
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    size_t threads;
+    uint64_t slice_cycles;
+    std::vector<Factory> jobs;
+    std::vector<MachineResult> results;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t> next_job;
+    std::atomic<size_t> remaining;
+
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    bool next_task(size_t, Task &);
+    bool steal(size_t, Task &);
+    void work(size_t);
+
+public:
+    Runner(size_t threads = 0, uint64_t slice_cycles = 10'000);
+    ~Runner() = default;
+
+    size_t add(Factory);
+    size_t add(const EmuFlags &, const std::vector<uint8_t> &);
+    std::vector<MachineResult> run();
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <functional>
+#include <queue>
+#include <unordered_set>
+#include <vector>
+#include <stdint.h>
+
+#define NO_EVENT UINT64_MAX
+
+namespace ANC216
+{
+    class Scheduler;
+
+    typedef uint64_t EventId;
+    typedef std::function<void(uint64_t)> EventAction;
+
+    struct Event
+    {
+        uint64_t when;
+        EventId id;
+        EventAction action;
+    };
+}
+
+// Device events keyed by the emulated cycle they are due at. The CPU runs
+// straight-line code until the earliest one instead of polling devices
+// after every instruction
+class ANC216::Scheduler
+{
+private:
+    struct Later
+    {
+        bool operator()(const Event &a, const Event &b) const
+        {
+            return a.when > b.when || (a.when == b.when && a.id > b.id);
+        }
+    };
+
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    std::unordered_set<EventId> cancelled;
+    EventId next_id = 1;
+
+public:
+    EventId schedule(uint64_t, EventAction);
+    void cancel(EventId);
+    uint64_t next_due();
+    void run_due(uint64_t);
+    void clear();
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <type_traits>
+#include <stdint.h>
+
+namespace ANC216
+{
+    // Single writer, any number of readers. The writer never waits, readers
+    // retry while a write is in progress. The value is kept in atomic words
+    // so that a torn read is detected instead of being a data race
+    template <typename T>
+    class Seqlock
+    {
+        static_assert(std::is_trivially_copyable_v<T>);
+
+    private:
+        static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        std::atomic<uint32_t> sequence = 0;
+        std::atomic<uint64_t> data[WORDS] = {};
+
+    public:
+        void write(const T &value)
+        {
+            uint64_t words[WORDS] = {};
+            std::memcpy(words, &value, sizeof(T));
+
+            uint32_t seq = sequence.load(std::memory_order_relaxed);
+            sequence.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < WORDS; i++)
+                data[i].store(words[i], std::memory_order_relaxed);
+            sequence.store(seq + 2, std::memory_order_release);
+        }
+
+        T read() const
+        {
+            uint64_t words[WORDS];
+            uint32_t before, after;
+            do
+            {
+                before = sequence.load(std::memory_order_acquire);
+                for (size_t i = 0; i < WORDS; i++)
+                    words[i] = data[i].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                after = sequence.load(std::memory_order_relaxed);
+            } while ((before & 1) || before != after);
+
+            T value;
+            std::memcpy(&value, words, sizeof(T));
+            return value;
+        }
+    };
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <types.hh>
+#include <cstddef>
+#include <stdint.h>
+
+#define AUDIO_SAMPLE_RATE 44'100
+
+namespace ANC216::Audio
+{
+    // Where an audio card sends its samples: the SDL audio device
+    // (audio.hh) or nowhere (NullSink). Samples are mono, signed 16 bit, at
+    // AUDIO_SAMPLE_RATE of host time. All the calls come from the CPU thread
+    class Sink
+    {
+    public:
+        virtual ~Sink() = default;
+
+        // Called once by the card
+        virtual void open(const EmuFlags &flags) = 0;
+        virtual void write(const int16_t *samples, size_t count) = 0;
+    };
+
+    // Drops the samples, for --headless and --noaudio. The card runs the
+    // same, so guests behave the same with and without sound
+    class NullSink : public Sink
+    {
+    private:
+        uint64_t samples = 0;
+
+    public:
+        void open(const EmuFlags &) override
+        {
+        }
+
+        void write(const int16_t *, size_t count) override
+        {
+            samples += count;
+        }
+
+        // Samples received since the card was mapped
+        uint64_t get_samples() const
+        {
+            return samples;
+        }
+    };
+}
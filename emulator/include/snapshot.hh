@@ -0,0 +1,48 @@
+#pragma once
+
+#include <common.hh>
+#include <timer.hh>
+#include <array>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ANC216
+{
+    typedef std::array<uint8_t, PAGE_SIZE> MemoryPage;
+}
+
+// The whole machine at one point between two time slices. Memory pages are
+// shared between snapshots: taking one only copies the pages written since
+// the previous one
+struct ANC216::Snapshot
+{
+    int16_t reg[8];
+    uint8_t sr;
+    uint16_t sp;
+    uint16_t bp;
+    uint16_t pc;
+    uint16_t current_instruction;
+    uint16_t mtu[6];
+    uint16_t cpid;
+
+    uint64_t cycles;
+    uint64_t instructions;
+    uint8_t pending_interrupts;
+    uint8_t nmi_code;
+    TimerState timer;
+
+    std::array<std::shared_ptr<const MemoryPage>, PAGES> imem;
+
+    // Device state in the order the devices were mapped, and the bus
+    // responses not yet delivered
+    std::vector<std::vector<uint8_t>> devices;
+    std::deque<BusResponse> responses;
+};
+
+namespace ANC216
+{
+    void save_snapshot(const std::string &, const Snapshot &);
+    Snapshot load_snapshot(const std::string &);
+}
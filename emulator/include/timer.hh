@@ -0,0 +1,41 @@
+#pragma once
+
+#include <scheduler.hh>
+
+namespace ANC216
+{
+    class Timer;
+
+    struct TimerState
+    {
+        uint64_t period;
+        uint64_t due;
+        bool running;
+    };
+}
+
+// The programmable timer. TIME sets the period in milliseconds, TSTART and
+// TSTOP arm and disarm it; once armed it expires every period until stopped
+class ANC216::Timer
+{
+private:
+    Scheduler &scheduler;
+    std::function<void()> on_expire;
+    uint64_t period = 0;
+    uint64_t due = 0;
+    EventId event = 0;
+    bool running = false;
+
+    void arm(uint64_t);
+    void schedule();
+
+public:
+    Timer(Scheduler &, std::function<void()>);
+    void set_period(uint16_t);
+    void start(uint64_t);
+    void stop();
+    bool is_running();
+    uint16_t remaining(uint64_t);
+    TimerState save_state();
+    void load_state(const TimerState &);
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <common.hh>
+#include <array>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// The format is read back by the disassembler (--trace), keep the two in
+// sync. Numbers are big endian, the file starts with the magic and the
+// version and then holds one record per instruction or interrupt:
+//
+//  type        1 byte, TRACE_INSTRUCTION or TRACE_INTERRUPT
+//  instruction pc (2), length (1) and the raw instruction bytes
+//  interrupt   source (1, the pending bit of the CPU) and the pc it
+//              returns to (2)
+//  registers   mask (2), then the new value of every register in the mask:
+//              R0-R7, SP and BP take 2 bytes, SR 1 byte
+//  writes      count (2), then address (2) and value (1) of each byte
+//              written to the internal memory
+#define TRACE_MAGIC "ANC216TR"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+
+namespace ANC216
+{
+    enum TraceRecordType
+    {
+        TRACE_INSTRUCTION,
+        TRACE_INTERRUPT,
+    };
+
+    // Bits of the register mask after R0-R7
+    enum TraceRegister
+    {
+        TRACE_SP = 8,
+        TRACE_BP = 9,
+        TRACE_SR = 10,
+    };
+}
+
+// Execution tracer for --trace. Records are packed into a ring of large
+// buffers and a writer thread writes every full buffer with a single call,
+// the CPU only waits when all the buffers are full
+class ANC216::Tracer
+{
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+    static constexpr size_t BUFFERS = 4;
+
+    CPU &cpu;
+    std::ofstream file;
+
+    std::array<std::vector<uint8_t>, BUFFERS> buffers;
+    // The CPU fills buffers[head], the writer writes buffers[tail] and the
+    // ones after it, queued in total
+    size_t head = 0;
+    size_t tail = 0;
+    size_t queued = 0;
+    bool closing = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    // The record being built, from before_instruction or before_interrupt
+    // to after
+    bool recording = false;
+    std::vector<uint8_t> record;
+    std::vector<uint8_t> writes;
+    uint16_t write_count = 0;
+    int16_t old_reg[8];
+    uint16_t old_sp;
+    uint16_t old_bp;
+    uint8_t old_sr;
+
+    void save_registers(uint8_t);
+    void submit();
+    void write_buffers();
+
+public:
+    Tracer(CPU &, const std::string &);
+    ~Tracer();
+
+    // The status register is passed by the CPU, which folds the lazy
+    // flags into it
+    void before_instruction(uint8_t);
+    void before_interrupt(uint8_t, uint8_t);
+    void after(uint8_t);
+    void flush();
+    void close();
+
+    inline void write(uint16_t address, uint8_t value)
+    {
+        if (!recording)
+            return;
+        writes.push_back(address >> 8);
+        writes.push_back(address & 0xFF);
+        writes.push_back(value);
+        write_count++;
+    }
+};
@@ -15,12 +15,32 @@ namespace ANC216
         char novideo : 1 = 0;
         char nokeyboard : 1 = 0;
         char fullscreen : 1 = 0;
+        char max_speed : 1 = 0;
+        char block_engine : 1 = 0;
+        char headless : 1 = 0;
         std::string gpu = "default";
         std::vector<std::pair<uint16_t, std::string>> extensions;
         std::vector<std::pair<uint16_t, std::string>> inserts;
         std::vector<std::pair<uint16_t, std::string>> cards;
         std::string charmap;
         float speed = 1;
+        uint32_t slice_cycles = 1000;
+        uint64_t max_instructions = 0;
+        uint32_t timeout = 0;
+        uint32_t history_size = 32;
+        uint64_t checkpoint_interval = 100'000;
         std::string bootfile = "";
+        std::string statefile = "";
+        std::string tracefile = "";
+        std::string profilefile = "";
+        uint64_t profile_interval = 1000;
+        std::string symbolfile = "";
+        std::string statsfile = "";
+        std::string batchfile = "";
+        uint32_t threads = 0;
+        std::string framefile = "";
+        std::string frame_format = "ppm";
+        uint64_t frame_interval = 0;
+        std::string hashfile = "";
     };
 }
\ No newline at end of file
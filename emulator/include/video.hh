@@ -1,52 +1,167 @@
 #pragma once
 
 #include <SDL.h>
+#include <display.hh>
 #include <stdexcept>
 #include <thread>
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <stdint.h>
 
 namespace ANC216::Video
 {
-    class Window
+    // SDL must be driven from the thread that created the window, so every
+    // call that touches it is queued and run by the window thread. The
+    // thread sleeps in SDL_WaitEventTimeout until an event arrives or the
+    // next refresh is due, then uploads the rows changed since the previous
+    // refresh to the streaming texture and presents it
+    class Window : public Display
     {
     private:
         SDL_Window *window = NULL;
         SDL_Renderer *renderer = NULL;
-        std::thread *thread;
+        SDL_Texture *texture = NULL;
+        int t_width = 0, t_height = 0;
+        std::thread *thread = nullptr;
         int r_width = 400, r_height = 400;
-        char last_key = '\0';
+        int refresh_rate = DEFAULT_REFRESH_RATE;
+        std::atomic<char> last_key = '\0';
+
+        std::mutex mutex;
+        std::condition_variable init_done;
+        bool initialized = false;
+        std::exception_ptr init_error;
+
+        // The picture the texture should show, and the rows of it not yet
+        // uploaded
+        Frame frame;
+        int dirty_first = INT_MAX;
+        int dirty_end = 0;
+        std::vector<std::function<void()>> tasks;
+        Uint32 wake_event = SDL_USEREVENT;
 
         void _init()
         {
-            if (SDL_Init(SDL_INIT_VIDEO) != 0)
-                throw std::runtime_error("Cannot initialize video");
-            window = SDL_CreateWindow("Emulated GPU video", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, r_width, r_height, SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN);
-            if (window == NULL)
-                throw std::runtime_error("Cannot create window");
+            try
+            {
+                if (SDL_Init(SDL_INIT_VIDEO) != 0)
+                    throw std::runtime_error("Cannot initialize video");
+                window = SDL_CreateWindow("Emulated GPU video", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, r_width, r_height, SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIDDEN);
+                if (window == NULL)
+                    throw std::runtime_error("Cannot create window");
 
-            renderer = SDL_CreateRenderer(window, 0, 0);
-            if (renderer == NULL)
-                throw std::runtime_error("Cannot init renderer");
+                renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+                if (renderer == NULL)
+                    throw std::runtime_error("Cannot init renderer");
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                init_error = std::current_exception();
+                initialized = true;
+                init_done.notify_all();
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                initialized = true;
+            }
+            init_done.notify_all();
 
-            auto run = true;
             SDL_Event event;
+            Uint32 period = 1000 / refresh_rate;
+            Uint32 next_refresh = SDL_GetTicks() + period;
+
+            while (true)
+            {
+                Uint32 now = SDL_GetTicks();
+                int timeout = (int32_t)(next_refresh - now) > 0 ? next_refresh - now : 0;
+
+                if (SDL_WaitEventTimeout(&event, timeout))
+                {
+                    switch (event.type)
+                    {
+                    case SDL_QUIT:
+                        SDL_Quit();
+                        exit(0);
+                        break;
+                    case SDL_KEYDOWN:
+                        last_key = event.key.keysym.sym;
+                        break;
+                    }
+                    run_tasks();
+                    continue;
+                }
+
+                run_tasks();
+                present();
+                now = SDL_GetTicks();
+                next_refresh += period;
+                if ((int32_t)(now - next_refresh) > (int32_t)period)
+                    next_refresh = now + period;
+            }
+        }
+
+        void run_tasks()
+        {
+            std::vector<std::function<void()>> pending;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.swap(tasks);
+            }
+            for (auto &task : pending)
+                task();
+        }
 
-            while (run)
+        void present()
+        {
             {
-                SDL_PollEvent(&event);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (dirty_first >= dirty_end)
+                    return;
 
-                switch (event.type)
+                if (texture == NULL || t_width != frame.width || t_height != frame.height)
                 {
-                case SDL_QUIT:
-                    run = false;
-                    SDL_Quit();
-                    exit(0);
-                    break;
-                case SDL_KEYDOWN:
-                    last_key = event.key.keysym.sym;
-                
+                    if (texture != NULL)
+                        SDL_DestroyTexture(texture);
+                    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, frame.width, frame.height);
+                    t_width = frame.width;
+                    t_height = frame.height;
+                    dirty_first = 0;
+                    dirty_end = frame.height;
                 }
+                SDL_Rect rows = {0, dirty_first, frame.width, dirty_end - dirty_first};
+                SDL_UpdateTexture(texture, &rows, frame.pixels.data() + dirty_first * frame.width, frame.width * sizeof(uint32_t));
+                dirty_first = INT_MAX;
+                dirty_end = 0;
             }
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+        }
+
+        void post(std::function<void()> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(std::move(task));
+            }
+            wake();
+        }
+
+        void wake()
+        {
+            SDL_Event event = {};
+            event.type = wake_event;
+            SDL_PushEvent(&event);
         }
 
     public:
@@ -63,7 +178,10 @@ namespace ANC216::Video
 
         inline void wait_init()
         {
-            while (renderer == NULL);
+            std::unique_lock<std::mutex> lock(mutex);
+            init_done.wait(lock, [this] { return initialized; });
+            if (init_error)
+                std::rethrow_exception(init_error);
         }
 
         inline void wait()
@@ -77,29 +195,65 @@ namespace ANC216::Video
             return last_key;
         }
 
+        // Opens the window at twice the resolution of the card
+        void open(int width, int height, const EmuFlags &flags) override
+        {
+            init();
+            wait_init();
+            change_window_res(width * 2, height * 2);
+            change_logical_res(width, height);
+            if (!flags.novideo)
+                show();
+            if (flags.fullscreen)
+                set_fullscreen();
+        }
+
+        // Only the rows changed since the previous refresh are uploaded,
+        // changing the size uploads the whole picture again
+        void update_rows(int width, int height, int row, int count, const uint32_t *pixels) override
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (frame.width != width || frame.height != height)
+            {
+                frame.width = width;
+                frame.height = height;
+                frame.pixels.assign((size_t)width * height, 0);
+                dirty_first = 0;
+                dirty_end = height;
+            }
+            std::copy(pixels, pixels + (size_t)count * width, frame.pixels.begin() + (size_t)row * width);
+            dirty_first = std::min(dirty_first, row);
+            dirty_end = std::max(dirty_end, row + count);
+        }
+
+        inline void set_refresh_rate(const int rate)
+        {
+            refresh_rate = rate;
+        }
+
         inline void change_logical_res(const int width, const int height)
         {
-            SDL_RenderSetLogicalSize(renderer, width, height);
+            post([this, width, height] { SDL_RenderSetLogicalSize(renderer, width, height); });
         }
 
         inline void change_window_res(const int width, const int height)
         {
-            SDL_SetWindowSize(window, width, height);
+            post([this, width, height] { SDL_SetWindowSize(window, width, height); });
         }
 
         inline void set_fullscreen()
         {
-            SDL_SetWindowFullscreen(window, 0);
+            post([this] { SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP); });
         }
 
         inline void show()
         {
-            SDL_ShowWindow(window);
+            post([this] { SDL_ShowWindow(window); });
         }
 
         inline void hide()
         {
-            SDL_HideWindow(window);
+            post([this] { SDL_HideWindow(window); });
         }
 
         inline SDL_Window *get_sdl_window()
@@ -112,4 +266,4 @@ namespace ANC216::Video
             return renderer;
         }
     };
-}
\ No newline at end of file
+}
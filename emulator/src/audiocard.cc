@@ -0,0 +1,192 @@
+#include <audiocard.hh>
+#include <cmath>
+#include <stdexcept>
+
+#define CHANNEL_STATE_SIZE 10
+#define STATE_SIZE (AUDIO_CHANNELS * CHANNEL_STATE_SIZE + 3)
+
+// Samples rendered at once, before going to the sink
+#define RENDER_BLOCK 256
+
+ANC216::AudioCard::AudioCard(EmemMapper *emem, EmuFlags flags, Audio::Sink *sink) : Device(emem, flags)
+{
+    this->id = ANC216::AUDIO_CARD;
+    this->sink = sink;
+    cycles_per_second = std::llround(CPU_CLOCK_HZ * (double)flags.speed);
+    sink->open(flags);
+    schedule_events();
+}
+
+// One channel in -128..127 before the volume. Tones too high for the host
+// have no step and are muted like the ones at 0 Hz
+inline int ANC216::AudioCard::sample(AudioChannel &ch)
+{
+    if (ch.step == 0 || ch.volume == 0)
+        return 0;
+
+    uint32_t previous = ch.phase;
+    ch.phase += ch.step;
+    int value;
+    switch (ch.wave)
+    {
+    case WAVE_SQUARE:
+        value = ch.phase < 0x80000000 ? 127 : -128;
+        break;
+    case WAVE_TRIANGLE:
+    {
+        int p = ch.phase >> 24;
+        value = p < 128 ? p * 2 - 128 : 383 - p * 2;
+        break;
+    }
+    case WAVE_SAWTOOTH:
+        value = (int)(ch.phase >> 24) - 128;
+        break;
+    default:
+        // 15 bit LFSR, one step per period
+        if (ch.phase < previous)
+            ch.noise = ch.noise >> 1 | ((ch.noise ^ ch.noise >> 1) & 1) << 14;
+        value = ch.noise & 1 ? 127 : -128;
+    }
+    return value * ch.volume / 255;
+}
+
+// Renders the samples due up to the cycle. The five sources together stay
+// within 16 bits
+void ANC216::AudioCard::render(uint64_t until)
+{
+    int16_t block[RENDER_BLOCK];
+    size_t count = 0;
+    while (origin + rendered * cycles_per_second / AUDIO_SAMPLE_RATE <= until)
+    {
+        int mix = (int)dac - 0x80;
+        for (auto &ch : channels)
+            mix += sample(ch);
+        block[count++] = mix * 48;
+        rendered++;
+        if (count == RENDER_BLOCK)
+        {
+            sink->write(block, count);
+            count = 0;
+        }
+    }
+    if (count > 0)
+        sink->write(block, count);
+}
+
+// The phase step is in host samples, the tone keeps its pitch in emulated
+// time
+void ANC216::AudioCard::set_frequency(AudioChannel &ch, uint16_t frequency)
+{
+    ch.frequency = frequency;
+    double step = frequency * 4294967296.0 * cycles_per_second / ((double)CPU_CLOCK_HZ * AUDIO_SAMPLE_RATE);
+    ch.step = step < 2147483648.0 ? (uint32_t)step : 0;
+}
+
+// Word written: data bus in bits 0-7, operation bus in bits 8-11 and mode
+// bus in bit 12 (1 write, 0 read). With the additional flag the low byte
+// goes to the DAC instead. The samples up to now are rendered with the
+// registers as they were
+void ANC216::AudioCard::cpu_write(uint16_t value, bool additional_flag)
+{
+    uint8_t data = value;
+    bool write = value & 0x1000 || additional_flag;
+    if (write)
+        render(emem->get_cycles());
+
+    if (additional_flag)
+    {
+        dac = data;
+        return;
+    }
+
+    AudioChannel &ch = channels[channel];
+    switch (value >> 8 & 0xF)
+    {
+    case AUDIO_CH:
+        if (write)
+            channel = data % AUDIO_CHANNELS;
+        else
+            latch = channel;
+        break;
+    case AUDIO_FL:
+        if (write)
+            set_frequency(ch, (ch.frequency & 0xFF00) | data);
+        else
+            latch = ch.frequency;
+        break;
+    case AUDIO_FH:
+        if (write)
+            set_frequency(ch, (ch.frequency & 0x00FF) | data << 8);
+        else
+            latch = ch.frequency >> 8;
+        break;
+    case AUDIO_VO:
+        if (write)
+            ch.volume = data;
+        else
+            latch = ch.volume;
+        break;
+    case AUDIO_WV:
+        if (write)
+            ch.wave = data & 3;
+        else
+            latch = ch.wave;
+        break;
+    }
+}
+
+uint16_t ANC216::AudioCard::cpu_read(uint16_t value, bool additional_flag)
+{
+    if (additional_flag)
+        return dac;
+    return latch;
+}
+
+void ANC216::AudioCard::tick(uint64_t when)
+{
+    render(when);
+    emem->schedule(when + AUDIO_TICK_CYCLES, [this](uint64_t when)
+                   { tick(when); });
+}
+
+// Samples start again from the current cycle, which goes back after
+// restoring a snapshot
+void ANC216::AudioCard::schedule_events()
+{
+    origin = emem->get_cycles();
+    rendered = 0;
+    uint64_t next = (origin / AUDIO_TICK_CYCLES + 1) * AUDIO_TICK_CYCLES;
+    emem->schedule(next, [this](uint64_t when)
+                   { tick(when); });
+}
+
+void ANC216::AudioCard::save_state(std::vector<uint8_t> &state) const
+{
+    state.clear();
+    for (auto &ch : channels)
+        state.insert(state.end(), {(uint8_t)ch.frequency, (uint8_t)(ch.frequency >> 8), ch.volume, ch.wave,
+                                   (uint8_t)ch.phase, (uint8_t)(ch.phase >> 8), (uint8_t)(ch.phase >> 16), (uint8_t)(ch.phase >> 24),
+                                   (uint8_t)ch.noise, (uint8_t)(ch.noise >> 8)});
+    state.insert(state.end(), {channel, dac, latch});
+}
+
+void ANC216::AudioCard::load_state(const std::vector<uint8_t> &state)
+{
+    if (state.size() != STATE_SIZE)
+        throw std::runtime_error("invalid audio card state");
+    for (int i = 0; i < AUDIO_CHANNELS; i++)
+    {
+        const uint8_t *s = &state[i * CHANNEL_STATE_SIZE];
+        AudioChannel &ch = channels[i];
+        set_frequency(ch, s[0] | s[1] << 8);
+        ch.volume = s[2];
+        ch.wave = s[3] & 3;
+        ch.phase = s[4] | s[5] << 8 | s[6] << 16 | (uint32_t)s[7] << 24;
+        ch.noise = (s[8] | s[9] << 8) & 0x7FFF;
+        if (ch.noise == 0)
+            ch.noise = 1;
+    }
+    channel = state[AUDIO_CHANNELS * CHANNEL_STATE_SIZE] % AUDIO_CHANNELS;
+    dac = state[AUDIO_CHANNELS * CHANNEL_STATE_SIZE + 1];
+    latch = state[AUDIO_CHANNELS * CHANNEL_STATE_SIZE + 2];
+}
@@ -1,19 +1,226 @@
 #include <avc64.hh>
+#include <algorithm>
+#include <stdexcept>
 
-#define W_AVC64_RES 256
-#define H_AVC64_RES 254
+#define STATE_SIZE (MAX_MEM + 7)
 
-ANC216::AVC64::AVC64(EmemMapper *emem, EmuFlags flags, Video::Window *win) : ANC216::VideoCard(emem, W_AVC64_RES * 2, H_AVC64_RES * 2, flags, win)
+// Colors are RRRGGGBB
+static uint32_t default_color(uint8_t color)
+{
+    uint32_t r = (color >> 5 & 7) * 255 / 7;
+    uint32_t g = (color >> 2 & 7) * 255 / 7;
+    uint32_t b = (color & 3) * 255 / 3;
+    return 0xFF000000 | r << 16 | g << 8 | b;
+}
+
+ANC216::AVC64::AVC64(EmemMapper *emem, EmuFlags flags, Video::Display *display) : ANC216::VideoCard(emem, W_AVC64_RES, H_AVC64_RES, flags, display), kernels(pixel_kernels()), blitter(memory.data(), AVC64_TEXTURE_MAP_SIZE)
 {
     this->id = ANC216::AVC64_VIDEO_CARD;
-    this->window->change_logical_res(W_AVC64_RES, H_AVC64_RES);
+    for (int i = 0; i < 256; i++)
+        palette[i] = default_color(i);
+    pixels.resize(W_AVC64_RES * H_AVC64_RES);
+    std::fill(dirty_rows, dirty_rows + H_AVC64_RES, true);
+    schedule_events();
+}
+
+// CX, CY and D1-D4 write the register or latch it for cpu_read
+inline void ANC216::AVC64::access(uint8_t &reg, bool write, uint8_t data)
+{
+    if (write)
+        reg = data;
+    else
+        latch = reg;
 }
 
+// Pixels out of the screen are dropped
+inline void ANC216::AVC64::set_pixel(unsigned px, unsigned py, uint8_t color)
+{
+    if (px >= W_AVC64_RES || py >= H_AVC64_RES)
+        return;
+    memory[AVC64_VRAM_ADDR + py * W_AVC64_RES + px] = color;
+    dirty_rows[py] = true;
+}
+
+// Word written: data bus in bits 0-7, operation bus in bits 8-11 and mode
+// bus in bit 12 (1 write, 0 read). With the additional flag the low byte
+// goes to the memory of the card instead
 void ANC216::AVC64::cpu_write(uint16_t value, bool additional_flag)
 {
+    if (additional_flag)
+        write_memory(value);
+    else
+        operate(value);
 }
 
 uint16_t ANC216::AVC64::cpu_read(uint16_t value, bool additional_flag)
 {
-    return 0;
+    if (additional_flag)
+        return read_memory();
+    return latch;
+}
+
+// A batch of writes, usually pixels or texture data streamed to the same
+// address
+void ANC216::AVC64::cpu_write_block(const uint16_t *values, size_t count, bool additional_flag)
+{
+    if (additional_flag)
+        for (size_t i = 0; i < count; i++)
+            write_memory(values[i]);
+    else
+        for (size_t i = 0; i < count; i++)
+            operate(values[i]);
+}
+
+void ANC216::AVC64::cpu_read_block(uint16_t offset, uint16_t *values, size_t count, bool additional_flag)
+{
+    if (additional_flag)
+        for (size_t i = 0; i < count; i++)
+            values[i] = read_memory();
+    else
+        std::fill(values, values + count, latch);
+}
+
+inline void ANC216::AVC64::operate(uint16_t value)
+{
+    uint8_t data = value;
+    bool write = value & 0x1000;
+    switch (value >> 8 & 0xF)
+    {
+    case AVC64_SP:
+        if (!write)
+        {
+            latch = y < H_AVC64_RES ? memory[AVC64_VRAM_ADDR + y * W_AVC64_RES + x] : 0;
+            break;
+        }
+        // Consecutive pixels can be written without moving the cursor
+        d1 = data;
+        set_pixel(x, y, data);
+        if (++x == 0)
+            y = (y + 1) % H_AVC64_RES;
+        break;
+    case AVC64_TX:
+        if (write)
+            draw_texture();
+        break;
+    case AVC64_CL:
+        if (write)
+            clear(d1 = data);
+        break;
+    case AVC64_CX:
+        access(x, write, data);
+        break;
+    case AVC64_CY:
+        access(y, write, data);
+        break;
+    case AVC64_D1:
+        access(d1, write, data);
+        break;
+    case AVC64_D2:
+        access(d2, write, data);
+        break;
+    case AVC64_D3:
+        access(d3, write, data);
+        break;
+    case AVC64_D4:
+        access(d4, write, data);
+        break;
+    case AVC64_FD:
+        if (write)
+            display->capture();
+        break;
+    }
+}
+
+// Memory accesses go to Y << 8 | X and move to the next address
+inline void ANC216::AVC64::write_memory(uint8_t data)
+{
+    uint16_t address = y << 8 | x;
+    memory[address] = data;
+    if (address >= AVC64_VRAM_ADDR)
+        dirty_rows[(address - AVC64_VRAM_ADDR) / W_AVC64_RES] = true;
+    else
+        blitter.written(address);
+    if (++x == 0)
+        y++;
+}
+
+inline uint8_t ANC216::AVC64::read_memory()
+{
+    uint8_t data = memory[y << 8 | x];
+    if (++x == 0)
+        y++;
+    return data;
+}
+
+void ANC216::AVC64::clear(uint8_t color)
+{
+    kernels.fill(&memory[AVC64_VRAM_ADDR], color, MAX_MEM - AVC64_VRAM_ADDR);
+    std::fill(dirty_rows, dirty_rows + H_AVC64_RES, true);
+}
+
+// Draws the texture D1 << 8 | D2 with its top left corner at X, Y
+void ANC216::AVC64::draw_texture()
+{
+    unsigned rows = blitter.draw(d1 << 8 | d2, x, y, d3, d4, &memory[AVC64_VRAM_ADDR], W_AVC64_RES, H_AVC64_RES);
+    std::fill(dirty_rows + y, dirty_rows + y + rows, true);
+}
+
+// Vertical blank: the rows written during the frame go to the display, in
+// runs of consecutive rows
+void ANC216::AVC64::end_frame(uint64_t when)
+{
+    for (int row = 0; row < H_AVC64_RES;)
+    {
+        if (!dirty_rows[row])
+        {
+            row++;
+            continue;
+        }
+        int first = row;
+        for (; row < H_AVC64_RES && dirty_rows[row]; row++)
+            dirty_rows[row] = false;
+        kernels.palette(&memory[AVC64_VRAM_ADDR + first * W_AVC64_RES], &pixels[first * W_AVC64_RES], (row - first) * W_AVC64_RES, palette.data());
+        display->update_rows(W_AVC64_RES, H_AVC64_RES, first, row - first, &pixels[first * W_AVC64_RES]);
+    }
+    display->end_frame();
+    emem->schedule(when + AVC64_FRAME_CYCLES, [this](uint64_t when)
+                   { end_frame(when); });
+}
+
+// Writes only show at the end of the frame, so they can arrive late, and
+// reads only return what was written before
+bool ANC216::AVC64::batches_transfers() const
+{
+    return true;
+}
+
+// Frames end on multiples of AVC64_FRAME_CYCLES, so they stay in the same
+// place after going back to a snapshot
+void ANC216::AVC64::schedule_events()
+{
+    uint64_t next = (emem->get_cycles() / AVC64_FRAME_CYCLES + 1) * AVC64_FRAME_CYCLES;
+    emem->schedule(next, [this](uint64_t when)
+                   { end_frame(when); });
+}
+
+void ANC216::AVC64::save_state(std::vector<uint8_t> &state) const
+{
+    state.assign(memory.begin(), memory.end());
+    state.insert(state.end(), {x, y, d1, d2, d3, d4, latch});
+}
+
+void ANC216::AVC64::load_state(const std::vector<uint8_t> &state)
+{
+    if (state.size() != STATE_SIZE)
+        throw std::runtime_error("invalid AVC64 state");
+    std::copy(state.begin(), state.begin() + MAX_MEM, memory.begin());
+    x = state[MAX_MEM];
+    y = state[MAX_MEM + 1];
+    d1 = state[MAX_MEM + 2];
+    d2 = state[MAX_MEM + 3];
+    d3 = state[MAX_MEM + 4];
+    d4 = state[MAX_MEM + 5];
+    latch = state[MAX_MEM + 6];
+    std::fill(dirty_rows, dirty_rows + H_AVC64_RES, true);
+    blitter.invalidate();
 }
@@ -0,0 +1,159 @@
+#include <blitter.hh>
+#include <algorithm>
+#include <cstring>
+
+#define HEADER_SIZE 5
+
+// Bits per pixel of the texture modes
+static const int texture_bits[] = {1, 2, 4, 8, 8, 12};
+
+ANC216::Blitter::Blitter(const uint8_t *map, size_t size)
+    : map(map), size(size), kernels(pixel_kernels())
+{
+    owners.resize(size);
+}
+
+// Finds the textures by walking the map, they are stored one after the
+// other and a header with a width or height of 0 ends the map. With two
+// textures with the same ID the first one is drawn
+void ANC216::Blitter::index()
+{
+    headers.clear();
+    textures.clear();
+    std::fill(owners.begin(), owners.end(), NO_TEXTURE);
+
+    size_t at = 0;
+    while (at + HEADER_SIZE <= size)
+    {
+        uint16_t id = map[at] << 8 | map[at + 1];
+        unsigned width = map[at + 2];
+        unsigned height = map[at + 3];
+        unsigned mode = map[at + 4] & 0xF;
+        if (width == 0 || height == 0 || mode > AVC64_256_COLORS_16_ALPHA)
+            break;
+        size_t bytes = (width * height * texture_bits[mode] + 7) / 8;
+        if (at + HEADER_SIZE + bytes > size)
+            break;
+        headers.emplace(id, at);
+        std::fill(owners.begin() + at + HEADER_SIZE, owners.begin() + at + HEADER_SIZE + bytes, id);
+        at += HEADER_SIZE + bytes;
+    }
+    indexed = true;
+}
+
+void ANC216::Blitter::decode(size_t at, Texture &texture)
+{
+    texture.width = map[at + 2];
+    texture.height = map[at + 3];
+    unsigned mode = map[at + 4] & 0xF;
+    unsigned count = texture.width * texture.height;
+    const uint8_t *data = map + at + HEADER_SIZE;
+    texture.two_colors = mode == AVC64_2_COLORS || mode == AVC64_2_COLORS_1_ALPHA;
+    texture.values.resize(count);
+    std::vector<uint8_t> &values = texture.values;
+    std::vector<uint8_t> &mask = texture.mask;
+
+    switch (mode)
+    {
+    case AVC64_2_COLORS_1_ALPHA:
+        kernels.unpack(data, values.data(), count, 2);
+        mask.resize(count);
+        for (unsigned i = 0; i < count; i++)
+        {
+            mask[i] = values[i] & 2 ? 0xFF : 0;
+            values[i] &= 1;
+        }
+        break;
+    case AVC64_16_COLORS_16_ALPHA:
+        kernels.unpack(data, values.data(), count, 8);
+        mask.resize(count);
+        for (unsigned i = 0; i < count; i++)
+        {
+            mask[i] = values[i] >> 4 ? 0xFF : 0;
+            values[i] &= 0xF;
+        }
+        break;
+    case AVC64_256_COLORS_16_ALPHA:
+        // 12 bit pixels, two in every three bytes
+        mask.resize(count);
+        for (unsigned i = 0; i < count; i++)
+        {
+            size_t bit = i * 12;
+            uint16_t value = (data[bit / 8] << 8 | data[bit / 8 + 1]) >> (4 - bit % 8) & 0xFFF;
+            values[i] = value;
+            mask[i] = value >> 8 ? 0xFF : 0;
+        }
+        break;
+    default:
+        kernels.unpack(data, values.data(), count, texture_bits[mode]);
+    }
+
+    texture.opaque = std::all_of(mask.begin(), mask.end(), [](uint8_t m)
+                                 { return m == 0xFF; });
+    if (texture.opaque)
+        mask.clear();
+}
+
+// Called for every byte of the map written
+void ANC216::Blitter::written(size_t address)
+{
+    if (!indexed)
+        return;
+    if (owners[address] == NO_TEXTURE)
+        indexed = false;
+    else
+        textures.erase(owners[address]);
+}
+
+// The whole map changed, e.g. loaded from a snapshot
+void ANC216::Blitter::invalidate()
+{
+    indexed = false;
+}
+
+// Draws the texture with its top left corner at x, y of a screen of one
+// byte per pixel, clipped to its right and bottom edges. one and zero are
+// the colors of the 2 color modes. Returns how many rows, from y, changed
+unsigned ANC216::Blitter::draw(uint16_t id, unsigned x, unsigned y, uint8_t one, uint8_t zero, uint8_t *screen, unsigned width, unsigned height)
+{
+    if (!indexed)
+        index();
+    auto found = textures.find(id);
+    if (found == textures.end())
+    {
+        auto header = headers.find(id);
+        if (header == headers.end())
+            return 0;
+        found = textures.emplace(id, Texture()).first;
+        decode(header->second, found->second);
+    }
+    Texture &texture = found->second;
+    if (x >= width || y >= height)
+        return 0;
+
+    const uint8_t *pixels = texture.values.data();
+    if (texture.two_colors)
+    {
+        if (texture.one != one || texture.zero != zero)
+        {
+            texture.colors.resize(texture.values.size());
+            kernels.select(texture.values.data(), texture.colors.data(), texture.values.size(), one, zero);
+            texture.one = one;
+            texture.zero = zero;
+        }
+        pixels = texture.colors.data();
+    }
+
+    unsigned visible = std::min(texture.width, width - x);
+    unsigned rows = std::min(texture.height, height - y);
+    for (unsigned i = 0; i < rows; i++)
+    {
+        const uint8_t *values = pixels + i * texture.width;
+        uint8_t *out = screen + (y + i) * width + x;
+        if (texture.opaque)
+            std::memcpy(out, values, visible);
+        else
+            kernels.masked_copy(values, &texture.mask[i * texture.width], out, visible);
+    }
+    return rows;
+}
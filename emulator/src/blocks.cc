@@ -0,0 +1,127 @@
+#include <blocks.hh>
+#include <algorithm>
+
+static bool ends_block(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case ANC216::KILL:
+    case ANC216::RESETI:
+    case ANC216::SYSCALL:
+    case ANC216::CALL:
+    case ANC216::RET:
+    case ANC216::POPC:
+        return true;
+    default:
+        return opcode >= ANC216::JMP && opcode <= ANC216::JNN;
+    }
+}
+
+ANC216::BlockEngine::BlockEngine(CPU &cpu) : cpu(cpu)
+{
+}
+
+// A block is listed once in every page it has code in
+void ANC216::BlockEngine::add_page(Block *block, uint16_t start, uint8_t page)
+{
+    cpu.code_pages[page] = true;
+    if (std::find(block->pages.begin(), block->pages.end(), page) != block->pages.end())
+        return;
+    block->pages.push_back(page);
+    page_blocks[page].push_back(start);
+}
+
+ANC216::Block *ANC216::BlockEngine::translate(uint16_t start)
+{
+    // The block it replaces may still be listed in its other pages
+    if (blocks[start] != nullptr)
+        for (uint8_t page : blocks[start]->pages)
+            std::erase(page_blocks[page], start);
+
+    auto block = std::make_unique<Block>();
+    uint16_t address = start;
+
+    while (block->code.size() < MAX_BLOCK_LENGTH)
+    {
+        BlockInstruction instruction;
+        cpu.decode(address, instruction.ins);
+        uint16_t last = address + instruction.ins.length - 1;
+        instruction.next_pc = address + instruction.ins.length;
+        instruction.step = CPU::block_steps[(instruction.ins.instruction & 0xFF) * (NONE + 1) + instruction.ins.mode];
+        instruction.address = instruction.next_pc + (int8_t)instruction.ins.arg;
+
+        add_page(block.get(), start, address / PAGE_SIZE);
+        add_page(block.get(), start, last / PAGE_SIZE);
+
+        block->code.push_back(instruction);
+        block->cycles += instruction.ins.cycles;
+        if (ends_block(instruction.ins.instruction & 0xFF) || instruction.next_pc < address)
+            break;
+        address = instruction.next_pc;
+    }
+
+    blocks[start] = std::move(block);
+    return blocks[start].get();
+}
+
+// Runs the instructions of the block, stopping where the interpreter
+// would: at the end of the run when checked, or after an instruction that
+// ends the slice, raises an interrupt, brings an event closer or writes to
+// a page holding code
+template <bool checked>
+void ANC216::BlockEngine::execute(const Block &block)
+{
+    const BlockInstruction *instruction = block.code.data();
+    const BlockInstruction *end = instruction + block.code.size();
+    cpu.exit_block = false;
+    for (; instruction != end; instruction++)
+    {
+        if constexpr (checked)
+            if (cpu.cycles >= cpu.run_end)
+                break;
+        cpu.pc = instruction->next_pc;
+        cpu.cycles += instruction->ins.cycles;
+        cpu.instructions++;
+        instruction->step(cpu, *instruction);
+        cpu.count(instruction->ins, instruction->next_pc);
+        if (cpu.exit_block)
+        {
+            instruction++;
+            break;
+        }
+    }
+    cpu.current_instruction = (instruction - 1)->ins.instruction;
+}
+
+// Runs blocks until the current run is over. Only the block that reaches
+// the end of the run checks it after every instruction
+void ANC216::BlockEngine::run()
+{
+    while (cpu.cycles < cpu.run_end)
+    {
+        Block *block = blocks[cpu.pc].get();
+        if (block == nullptr || !block->valid)
+            block = translate(cpu.pc);
+
+        if (cpu.cycles + block->cycles <= cpu.run_end)
+            execute<false>(*block);
+        else
+            execute<true>(*block);
+    }
+}
+
+void ANC216::BlockEngine::invalidate_page(uint8_t page)
+{
+    for (uint16_t start : page_blocks[page])
+        if (blocks[start] != nullptr)
+            blocks[start]->valid = false;
+    page_blocks[page].clear();
+    cpu.code_pages[page] = false;
+    cpu.exit_block = true;
+}
+
+void ANC216::BlockEngine::flush()
+{
+    for (size_t page = 0; page < PAGES; page++)
+        invalidate_page(page);
+}
@@ -0,0 +1,223 @@
+#include <common.hh>
+#include <counters.hh>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+static const char *opcode_name(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case ANC216::KILL: return "kill";
+    case ANC216::RESETI: return "reseti";
+    case ANC216::CPUID: return "cpuid";
+    case ANC216::SYSCALL: return "syscall";
+    case ANC216::CALL: return "call";
+    case ANC216::RET: return "ret";
+    case ANC216::PUSH: return "push";
+    case ANC216::POP: return "pop";
+    case ANC216::PHPC: return "phpc";
+    case ANC216::POPC: return "popc";
+    case ANC216::PHSR: return "phsr";
+    case ANC216::POSR: return "posr";
+    case ANC216::PHSP: return "phsp";
+    case ANC216::POSP: return "posp";
+    case ANC216::PHBP: return "phbp";
+    case ANC216::POBP: return "pobp";
+    case ANC216::SETI: return "seti";
+    case ANC216::SETT: return "sett";
+    case ANC216::SETS: return "sets";
+    case ANC216::CLRI: return "clri";
+    case ANC216::CLRT: return "clrt";
+    case ANC216::CLRS: return "clrs";
+    case ANC216::CLRN: return "clrn";
+    case ANC216::CLRO: return "clro";
+    case ANC216::CLRC: return "clrc";
+    case ANC216::IREQ: return "ireq";
+    case ANC216::REQ: return "req";
+    case ANC216::WRITE: return "write";
+    case ANC216::HREQ: return "hreq";
+    case ANC216::HWRITE: return "hwrite";
+    case ANC216::READ: return "read";
+    case ANC216::PAREQ: return "pareq";
+    case ANC216::CMP: return "cmp";
+    case ANC216::CAREQ: return "careq";
+    case ANC216::JMP: return "jmp";
+    case ANC216::JEQ: return "jeq";
+    case ANC216::JNE: return "jne";
+    case ANC216::JGE: return "jge";
+    case ANC216::JGR: return "jgr";
+    case ANC216::JLE: return "jle";
+    case ANC216::JLS: return "jls";
+    case ANC216::JO: return "jo";
+    case ANC216::JNO: return "jno";
+    case ANC216::JN: return "jn";
+    case ANC216::JNN: return "jnn";
+    case ANC216::INC: return "inc";
+    case ANC216::DEC: return "dec";
+    case ANC216::ADD: return "add";
+    case ANC216::SUB: return "sub";
+    case ANC216::NEG: return "neg";
+    case ANC216::AND: return "and";
+    case ANC216::OR: return "or";
+    case ANC216::XOR: return "xor";
+    case ANC216::NOT: return "not";
+    case ANC216::SIGN: return "sign";
+    case ANC216::SHL: return "shl";
+    case ANC216::SHR: return "shr";
+    case ANC216::PAR: return "par";
+    case ANC216::LOAD: return "load";
+    case ANC216::STORE: return "store";
+    case ANC216::TRAN: return "tran";
+    case ANC216::SWAP: return "swap";
+    case ANC216::LDSR: return "ldsr";
+    case ANC216::LDSP: return "ldsp";
+    case ANC216::LDBP: return "ldbp";
+    case ANC216::STSR: return "stsr";
+    case ANC216::STSP: return "stsp";
+    case ANC216::STBP: return "stbp";
+    case ANC216::TRSR: return "trsr";
+    case ANC216::TRSP: return "trsp";
+    case ANC216::TRBP: return "trbp";
+    case ANC216::SILI: return "sili";
+    case ANC216::SIHI: return "sihi";
+    case ANC216::SELI: return "seli";
+    case ANC216::SEHI: return "sehi";
+    case ANC216::SBP: return "sbp";
+    case ANC216::STP: return "stp";
+    case ANC216::TILI: return "tili";
+    case ANC216::TIHI: return "tihi";
+    case ANC216::TELI: return "teli";
+    case ANC216::TEHI: return "tehi";
+    case ANC216::TBP: return "tbp";
+    case ANC216::TTP: return "ttp";
+    case ANC216::LCPID: return "lcpid";
+    case ANC216::TCPID: return "tcpid";
+    case ANC216::TIME: return "time";
+    case ANC216::TSTART: return "tstart";
+    case ANC216::TSTOP: return "tstop";
+    case ANC216::TRT: return "trt";
+    }
+    return nullptr;
+}
+
+static const char *mode_names[] = {
+    "implied",
+    "immediate_byte",
+    "immediate_word",
+    "register",
+    "low_register",
+    "register_to_register",
+    "absolute",
+    "absolute_indexed",
+    "indirect",
+    "indirect_indexed",
+    "relative_to_pc",
+    "relative_to_pc_with_register",
+    "relative_to_bp",
+    "relative_to_bp_with_register",
+    "immediate_to_absolute",
+    "immediate_to_absolute_indexed",
+    "immediate_to_relative_to_bp",
+    "immediate_to_relative_to_bp_with_register",
+    "register_to_absolute",
+    "absolute_to_register",
+    "immediate_to_register",
+    "register_to_relative_to_pc",
+    "relative_to_pc_to_register",
+    "register_to_relative_to_bp",
+    "relative_to_bp_to_register",
+    "low_register_to_absolute",
+    "absolute_to_low_register",
+    "immediate_to_low_register",
+    "low_register_to_relative_to_pc",
+    "relative_to_pc_to_low_register",
+    "low_register_to_relative_to_bp",
+    "relative_to_bp_to_low_register",
+    "invalid",
+};
+
+static const char *bus_names[] = {"info_requests", "requests", "writes", "reads", "responses"};
+
+// Opcodes the CPU doesn't know are named by their value
+static std::string opcode_key(uint8_t opcode)
+{
+    if (opcode_name(opcode) != nullptr)
+        return opcode_name(opcode);
+    std::stringstream key;
+    key << "0x" << std::hex << std::setw(2) << std::setfill('0') << (int)opcode;
+    return key.str();
+}
+
+static std::string region_key(size_t region)
+{
+    std::stringstream key;
+    key << std::hex << std::setfill('0') << std::setw(4) << region * STATS_REGION_SIZE
+        << "-" << std::setw(4) << (region + 1) * STATS_REGION_SIZE - 1;
+    return key.str();
+}
+
+void ANC216::Counters<false>::write_json(std::ostream &out) const
+{
+    out << "{\"enabled\": false}\n";
+}
+
+void ANC216::Counters<true>::clear()
+{
+    std::fill(std::begin(opcodes), std::end(opcodes), 0);
+    std::fill(std::begin(modes), std::end(modes), 0);
+    std::fill(std::begin(taken), std::end(taken), 0);
+    std::fill(std::begin(not_taken), std::end(not_taken), 0);
+    std::fill(std::begin(reads), std::end(reads), 0);
+    std::fill(std::begin(writes), std::end(writes), 0);
+    std::fill(std::begin(transactions), std::end(transactions), 0);
+}
+
+// Only the entries that aren't zero are written
+void ANC216::Counters<true>::write_json(std::ostream &out) const
+{
+    const char *separator = "";
+    out << "{\n  \"enabled\": true,\n  \"opcodes\": {";
+    for (int i = 0; i < 256; i++)
+    {
+        if (opcodes[i] == 0)
+            continue;
+        out << separator << "\n    \"" << opcode_key(i) << "\": " << opcodes[i];
+        separator = ",";
+    }
+
+    separator = "";
+    out << "\n  },\n  \"addressing_modes\": {";
+    for (int i = 0; i <= NONE; i++)
+    {
+        if (modes[i] == 0)
+            continue;
+        out << separator << "\n    \"" << mode_names[i] << "\": " << modes[i];
+        separator = ",";
+    }
+
+    separator = "";
+    out << "\n  },\n  \"branches\": {";
+    for (int i = 0; i < 256; i++)
+    {
+        if (taken[i] == 0 && not_taken[i] == 0)
+            continue;
+        out << separator << "\n    \"" << opcode_key(i) << "\": {\"taken\": " << taken[i] << ", \"not_taken\": " << not_taken[i] << "}";
+        separator = ",";
+    }
+
+    separator = "";
+    out << "\n  },\n  \"memory\": {";
+    for (size_t i = 0; i < STATS_REGIONS; i++)
+    {
+        if (reads[i] == 0 && writes[i] == 0)
+            continue;
+        out << separator << "\n    \"" << region_key(i) << "\": {\"reads\": " << reads[i] << ", \"writes\": " << writes[i] << "}";
+        separator = ",";
+    }
+
+    out << "\n  },\n  \"bus\": {";
+    for (int i = 0; i < BUS_TRANSACTIONS; i++)
+        out << (i == 0 ? "" : ",") << "\n    \"" << bus_names[i] << "\": " << transactions[i];
+    out << "\n  }\n}\n";
+}
@@ -1,4 +1,11 @@
 #include <cpu.hh>
+#include <blocks.hh>
+#include <snapshot.hh>
+#include <history.hh>
+#include <debugger.hh>
+#include <trace.hh>
+#include <profiler.hh>
+#include <cstring>
 
 #pragma once
 
@@ -8,479 +15,1447 @@
 #define X1_REG_MASK 0b11'000'111
 #define X2_REG_MASK 0b11'000'000
 
-#define X1_GET_REG(x) (x & 0b00111000) >> 3
-#define X2_GET_REG(x) x & 0b00000111
+#define X1_GET_REG(x) (((x) & 0b00111000) >> 3)
+#define X2_GET_REG(x) ((x) & 0b00000111)
 
 #define NEGATIVE_FLAG 0b1000'0000
 #define OVERFLOW_FLAG 0b0100'0000
 #define INTERRPUTS_FLAG 0b0010'0000
 #define TIMER_INTERRUPT_FLAG 0b0001'0000
 #define SYSTEM_PRIVILEGES_FLAG 0b0000'1000
+#define ADDITIONAL_INFO_FLAG 0b0000'0100
 #define ZERO_FLAG 0b0000'0010
 #define CARRY_FLAG 0b0000'0001
 
+#define FLAGS_NONE 0
+#define FLAGS_ADD 1
+#define FLAGS_SUB 2
+
+#define SIZE_MASK(size) ((size) == BYTE_S ? 0x00FF : 0xFFFF)
+#define SIGN_BIT(size) ((size) == BYTE_S ? 0x0080 : 0x8000)
+
+#define EINR_INTERRUPT 0b0001
+#define NMI_INTERRUPT 0b0010
+#define SYSCALL_INTERRUPT 0b0100
+#define TIMER_INTERRUPT 0b1000
+
+#define EINR_VECTOR 0x0002
+#define NMI_VECTOR 0x0004
+#define SYSCALL_VECTOR 0x0006
+#define TIMER_VECTOR 0x0008
+#define SYSTEM_SP_ADDR 0x000C
+#define INTERRUPT_BP 0x3000
+#define SAVED_SP_ADDR 0x31FE
+// PC, SR and BP of the interrupted code, at the bottom of the system stack
+#define INTERRUPT_FRAME_SIZE 5
+
 #define CHECK_SYSTEM_PRIVILEGES()\
-    if (!(sr & SYSTEM_PRIVILEGES_FLAG))\
+    if (!(cpu.sr & SYSTEM_PRIVILEGES_FLAG))\
     {\
-        reg[0] = 4;\
-        nmi();\
+        cpu.nmi(NMI_PRIVILEGES);\
+        return;\
+    }
+
+inline uint8_t ANC216::CPU::read_byte(uint16_t address)
+{
+    counters.read(address);
+    return imem[address];
+}
+
+inline uint16_t ANC216::CPU::read_word(uint16_t address)
+{
+    counters.read(address);
+    counters.read(address + 1);
+    return imem[address] << 8 | imem[(uint16_t)(address + 1)];
+}
+
+inline void ANC216::CPU::write_byte(uint16_t address, uint8_t value)
+{
+    imem[address] = value;
+    counters.write(address);
+    dirty_pages[address / PAGE_SIZE] = true;
+    if (watched_pages[address / PAGE_SIZE])
+        debugger->check_write(address);
+    if (tracer != nullptr)
+        tracer->write(address, value);
+    invalidate(address);
+}
+
+inline void ANC216::CPU::write_word(uint16_t address, uint16_t value)
+{
+    write_byte(address, value >> 8);
+    write_byte(address + 1, value & 0xFF);
+}
+
+inline void ANC216::CPU::push_byte(uint8_t value)
+{
+    write_byte(sp, value);
+    sp++;
+}
+
+inline void ANC216::CPU::push_word(uint16_t value)
+{
+    write_word(sp, value);
+    sp += 2;
+}
+
+inline uint8_t ANC216::CPU::pop_byte()
+{
+    sp--;
+    return read_byte(sp);
+}
+
+inline uint16_t ANC216::CPU::pop_word()
+{
+    sp -= 2;
+    return read_word(sp);
+}
+
+// The longest instruction is 6 bytes, so a write can only change the
+// instructions decoded from the 6 addresses ending at it
+inline void ANC216::CPU::invalidate(uint16_t address)
+{
+    for (uint16_t i = 0; i < 6; i++)
+        decode_cache[(uint16_t)(address - i)].valid = false;
+    if (code_pages[address / PAGE_SIZE])
+        blocks->invalidate_page(address / PAGE_SIZE);
+}
+
+// Value written by instructions that store either an immediate or x1
+inline uint16_t ANC216::CPU::store_value(const DecodedInstruction &ins, const Operand &op)
+{
+    if (ins.mode >= IMMEDIATE_TO_MEMORY_ABSOLUTE && ins.mode <= IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER)
+        return op.value;
+    return op.size == BYTE_S ? reg[ins.x1] & 0xFF : (uint16_t)reg[ins.x1];
+}
+
+inline uint16_t ANC216::CPU::load_value(const Operand &op)
+{
+    if (!op.memory)
+        return op.value;
+    return op.size == BYTE_S ? read_byte(op.address) : read_word(op.address);
+}
+
+// Writing a low register leaves the high part untouched
+inline void ANC216::CPU::set_register(uint8_t id, uint16_t value, uint8_t size)
+{
+    if (size == BYTE_S)
+        reg[id] = (reg[id] & 0xFF00) | (value & 0xFF);
+    else
+        reg[id] = value;
+}
+
+// Logical results leave O and C as they are, so a pending arithmetic
+// operation has to be folded into sr before it is replaced
+inline void ANC216::CPU::set_nz(uint16_t result, uint8_t size)
+{
+    if (flags_op != FLAGS_NONE)
+        materialize_flags();
+    flags_result = result & SIZE_MASK(size);
+    flags_size = size;
+}
+
+inline void ANC216::CPU::set_arithmetic(uint8_t op, uint16_t a, uint16_t b, uint16_t result, uint8_t size)
+{
+    flags_result = result & SIZE_MASK(size);
+    flags_size = size;
+    flags_op = op;
+    flags_a = a & SIZE_MASK(size);
+    flags_b = b & SIZE_MASK(size);
+}
+
+inline bool ANC216::CPU::flag_n()
+{
+    return flags_size ? flags_result & SIGN_BIT(flags_size) : sr & NEGATIVE_FLAG;
+}
+
+inline bool ANC216::CPU::flag_z()
+{
+    return flags_size ? flags_result == 0 : sr & ZERO_FLAG;
+}
+
+inline bool ANC216::CPU::flag_o()
+{
+    uint16_t sign = SIGN_BIT(flags_size);
+    switch (flags_op)
+    {
+    case FLAGS_ADD:
+        return (flags_a ^ flags_result) & (flags_b ^ flags_result) & sign;
+    case FLAGS_SUB:
+        return (flags_a ^ flags_b) & (flags_a ^ flags_result) & sign;
+    default:
+        return sr & OVERFLOW_FLAG;
+    }
+}
+
+inline bool ANC216::CPU::flag_c()
+{
+    switch (flags_op)
+    {
+    case FLAGS_ADD:
+        return flags_a + flags_b > SIZE_MASK(flags_size);
+    case FLAGS_SUB:
+        return flags_a < flags_b;
+    default:
+        return sr & CARRY_FLAG;
+    }
+}
+
+inline void ANC216::CPU::materialize_flags()
+{
+    if (flags_size == 0)
+        return;
+    uint8_t flags = (flag_n() ? NEGATIVE_FLAG : 0) | (flag_o() ? OVERFLOW_FLAG : 0) |
+                    (flag_z() ? ZERO_FLAG : 0) | (flag_c() ? CARRY_FLAG : 0);
+    sr = (sr & ~(NEGATIVE_FLAG | OVERFLOW_FLAG | ZERO_FLAG | CARRY_FLAG)) | flags;
+    flags_size = 0;
+    flags_op = FLAGS_NONE;
+}
+
+inline uint8_t ANC216::CPU::get_sr()
+{
+    materialize_flags();
+    return sr;
+}
+
+inline void ANC216::CPU::set_sr(uint8_t value)
+{
+    flags_size = 0;
+    flags_op = FLAGS_NONE;
+    sr = value;
+}
+
+void ANC216::CPU::flush_decode_cache()
+{
+    for (size_t i = 0; i < MAX_MEM; i++)
+        decode_cache[i].valid = false;
+    if (blocks != nullptr)
+        blocks->flush();
+}
+template <ANC216::AddressingMode>
+void ANC216::CPU::fetch(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, 0, 0, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_BYTE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {(uint16_t)(ins.arg & 0xFF), 0, BYTE_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_WORD>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg, 0, WORD_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::REGISTER_ACCESS_MODE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {(uint16_t)cpu.reg[ins.x1], 0, WORD_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::LOW_REGISTER_ACCESS_MODE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {(uint16_t)(cpu.reg[ins.x1] & 0xFF), 0, BYTE_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::REGISTER_TO_REGISTER_MODE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {(uint16_t)cpu.reg[ins.x2], 0, WORD_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_ABSOULTE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, ins.arg, WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_ABSOULTE_INDEXED>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(ins.arg + (int8_t)cpu.reg[ins.x1]), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_INDIRECT>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, cpu.read_word(ins.arg), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_INDIRECT_INDEXED>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.read_word(ins.arg) + (int8_t)cpu.reg[ins.x1]), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_PC>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.pc + (int8_t)ins.arg), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_PC_WITH_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.pc + (int8_t)cpu.reg[ins.x1]), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_BP>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.bp + (int8_t)ins.arg), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_BP_WITH_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.bp + (int8_t)cpu.reg[ins.x1]), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_MEMORY_ABSOLUTE>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg2, ins.arg, ins.immsize, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg2, (uint16_t)(ins.arg + (int8_t)cpu.reg[ins.x1]), BYTE_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg2, (uint16_t)(cpu.bp + (int8_t)ins.arg), ins.immsize, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg2, (uint16_t)(cpu.bp + (int8_t)cpu.reg[ins.x1]), ins.immsize, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_ABSOULTE_TO_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, ins.arg, WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {ins.arg, 0, WORD_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_PC_TO_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.pc + (int8_t)ins.arg), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_BP_TO_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.bp + (int8_t)ins.arg), WORD_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_ABSOULTE_TO_LOW_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, ins.arg, BYTE_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::IMMEDIATE_TO_LOW_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {(uint16_t)(ins.arg & 0xFF), 0, BYTE_S, false};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.pc + (int8_t)ins.arg), BYTE_S, true};
+}
+
+template <>
+void ANC216::CPU::fetch<ANC216::MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER>(CPU &cpu, const DecodedInstruction &ins, Operand &op)
+{
+    op = {0, (uint16_t)(cpu.bp + (int8_t)ins.arg), BYTE_S, true};
+}
+
+#define ADDRESSING(mode, argsize, immsize) AddressingInfo{mode, argsize, immsize, x1, x2, &fetch<mode>}
+
+// Mirrors the addressing byte layout: 2 bits of family, then x1 and x2 (3 bits each)
+constexpr ANC216::AddressingInfo ANC216::CPU::decode_addressing(uint8_t addr)
+{
+    uint8_t x1 = X1_GET_REG(addr);
+    uint8_t x2 = X2_GET_REG(addr);
+
+    switch (addr >> 6)
+    {
+    case 0b00:
+        switch (x2)
+        {
+        case 0b000:
+            if (x1 == 0b000)
+                return ADDRESSING(IMPLIED_MODE, 0, 0);
+            if (x1 == 0b001)
+                return ADDRESSING(IMMEDIATE_BYTE, 1, 0);
+            if (x1 == 0b010)
+                return ADDRESSING(IMMEDIATE_WORD, 2, 0);
+            break;
+        case 0b001:
+            return ADDRESSING(REGISTER_ACCESS_MODE, 0, 0);
+        case 0b010:
+            return ADDRESSING(LOW_REGISTER_ACCESS_MODE, 0, 0);
+        case 0b011:
+            if (x1 == 0b000)
+                return ADDRESSING(IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP, 2, 1);
+            if (x1 == 0b001)
+                return ADDRESSING(IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP, 3, 2);
+            break;
+        case 0b100:
+            return ADDRESSING(IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER, 1, 1);
+        case 0b101:
+            return ADDRESSING(IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER, 2, 2);
+        case 0b110:
+            if (x1 == 0b000)
+                return ADDRESSING(IMMEDIATE_TO_MEMORY_ABSOLUTE, 3, 1);
+            if (x1 == 0b001)
+                return ADDRESSING(IMMEDIATE_TO_MEMORY_ABSOLUTE, 4, 2);
+            break;
+        case 0b111:
+            return ADDRESSING(IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED, 3, 1);
+        }
+        break;
+    case 0b01:
+        return ADDRESSING(REGISTER_TO_REGISTER_MODE, 0, 0);
+    case 0b10:
+        switch (x2)
+        {
+        case 0b000:
+            if (x1 == 0b000)
+                return ADDRESSING(MEMORY_ABSOULTE, 2, 0);
+            break;
+        case 0b001:
+            return ADDRESSING(MEMORY_ABSOULTE_INDEXED, 2, 0);
+        case 0b010:
+            if (x1 == 0b000)
+                return ADDRESSING(MEMORY_INDIRECT, 2, 0);
+            break;
+        case 0b011:
+            return ADDRESSING(MEMORY_INDIRECT_INDEXED, 2, 0);
+        case 0b100:
+            if (x1 == 0b000)
+                return ADDRESSING(MEMORY_RELATIVE_TO_PC, 1, 0);
+            if (x1 == 0b001)
+                return ADDRESSING(MEMORY_RELATIVE_TO_BP, 1, 0);
+            break;
+        case 0b101:
+            return ADDRESSING(MEMORY_RELATIVE_TO_PC_WITH_REGISTER, 0, 0);
+        case 0b110:
+            return ADDRESSING(MEMORY_RELATIVE_TO_BP_WITH_REGISTER, 0, 0);
+        }
+        break;
+    case 0b11:
+        switch (x2)
+        {
+        case 0b000:
+            return ADDRESSING(MEMORY_ABSOULTE_TO_REGISTER, 2, 0);
+        case 0b001:
+            return ADDRESSING(IMMEDIATE_TO_REGISTER, 2, 0);
+        case 0b010:
+            return ADDRESSING(MEMORY_RELATIVE_TO_PC_TO_REGISTER, 1, 0);
+        case 0b011:
+            return ADDRESSING(MEMORY_RELATIVE_TO_BP_TO_REGISTER, 1, 0);
+        case 0b100:
+            return ADDRESSING(MEMORY_ABSOULTE_TO_LOW_REGISTER, 2, 0);
+        case 0b101:
+            return ADDRESSING(IMMEDIATE_TO_LOW_REGISTER, 1, 0);
+        case 0b110:
+            return ADDRESSING(MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER, 1, 0);
+        case 0b111:
+            return ADDRESSING(MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER, 1, 0);
+        }
+        break;
+    }
+
+    return ADDRESSING(NONE, 0, 0);
+}
+
+#undef ADDRESSING
+
+constexpr std::array<ANC216::AddressingInfo, 256> ANC216::CPU::addressing_table = []
+{
+    std::array<AddressingInfo, 256> table{};
+    for (int i = 0; i < 256; i++)
+        table[i] = decode_addressing(i);
+    return table;
+}();
+
+// How an addressing byte is decoded, for the tests
+const ANC216::AddressingInfo &ANC216::CPU::addressing(uint8_t addr)
+{
+    return addressing_table[addr];
+}
+
+#define HANDLER(opcode) \
+    template <>         \
+    void ANC216::CPU::exec<ANC216::opcode>(CPU &cpu, const DecodedInstruction &ins, const Operand &op)
+
+template <uint8_t>
+void ANC216::CPU::exec(CPU &cpu, const DecodedInstruction &ins, const Operand &op)
+{
+    cpu.nmi(NMI_BAD_OPCODE);
+}
+
+HANDLER(KILL)
+{
+    cpu.killed = true;
+    cpu.end_slice();
+}
+
+HANDLER(RESETI)
+{
+    cpu.nmi(NMI_SOFT_RESET);
+}
+
+HANDLER(CPUID)
+{
+    cpu.reg[0] = (int16_t)0x8000;
+}
+
+HANDLER(SYSCALL)
+{
+    if (cpu.flags.fast_mode)
+        cpu.host_syscall();
+    else
+        cpu.interrupt(SYSCALL_INTERRUPT);
+}
+
+HANDLER(CALL)
+{
+    cpu.push_word(cpu.pc);
+    cpu.push_byte(cpu.get_sr());
+    cpu.pc = op.memory ? op.address : op.value;
+    cpu.bp = cpu.sp;
+}
+
+// BP is only at INTERRUPT_BP in an interrupt handler, there RET goes back
+// to the interrupted code
+HANDLER(RET)
+{
+    if (cpu.bp == INTERRUPT_BP)
+    {
+        cpu.leave_interrupt();
+        return;
+    }
+    cpu.sp = cpu.bp;
+    cpu.set_sr(cpu.pop_byte());
+    cpu.pc = cpu.pop_word();
+}
+
+HANDLER(PUSH)
+{
+    if (op.size == BYTE_S)
+        cpu.push_byte(op.value);
+    else
+        cpu.push_word(op.value);
+}
+
+HANDLER(POP)
+{
+    if (ins.mode == LOW_REGISTER_ACCESS_MODE)
+        cpu.set_register(ins.x1, cpu.pop_byte(), BYTE_S);
+    else
+        cpu.reg[ins.x1] = cpu.pop_word();
+}
+
+HANDLER(PHPC)
+{
+    cpu.push_word(cpu.pc);
+}
+
+HANDLER(POPC)
+{
+    cpu.pc = cpu.pop_word();
+}
+
+HANDLER(PHSR)
+{
+    cpu.push_byte(cpu.get_sr());
+}
+
+HANDLER(POSR)
+{
+    cpu.set_sr(cpu.pop_byte());
+}
+
+HANDLER(PHSP)
+{
+    cpu.push_word(cpu.sp);
+}
+
+HANDLER(POSP)
+{
+    cpu.sp = cpu.pop_word();
+}
+
+HANDLER(PHBP)
+{
+    cpu.push_word(cpu.bp);
+}
+
+HANDLER(POBP)
+{
+    cpu.bp = cpu.pop_word();
+}
+
+HANDLER(SETI)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr |= INTERRPUTS_FLAG;
+}
+
+HANDLER(SETT)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr |= TIMER_INTERRUPT_FLAG;
+}
+
+HANDLER(SETS)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr |= SYSTEM_PRIVILEGES_FLAG;
+}
+
+HANDLER(CLRI)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr &= ~INTERRPUTS_FLAG;
+}
+
+HANDLER(CLRT)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr &= ~TIMER_INTERRUPT_FLAG;
+}
+
+HANDLER(CLRS)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.sr &= ~SYSTEM_PRIVILEGES_FLAG;
+}
+
+HANDLER(CLRN)
+{
+    cpu.materialize_flags();
+    cpu.sr &= ~NEGATIVE_FLAG;
+}
+
+HANDLER(CLRO)
+{
+    cpu.materialize_flags();
+    cpu.sr &= ~OVERFLOW_FLAG;
+}
+
+HANDLER(CLRC)
+{
+    cpu.materialize_flags();
+    cpu.sr &= ~CARRY_FLAG;
+}
+
+HANDLER(IREQ)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.counters.bus(BUS_INFO_REQUEST);
+    if (op.memory)
+        cpu.emem->info_req(op.address);
+    else
+        cpu.emem->info_req(op.value);
+}
+
+HANDLER(REQ)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.counters.bus(BUS_REQUEST);
+    cpu.emem->request(op.memory ? op.address : op.value, cpu.sr & ADDITIONAL_INFO_FLAG, false);
+}
+
+HANDLER(WRITE)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.counters.bus(BUS_WRITE);
+    cpu.emem->write(cpu.store_value(ins, op), op.address, cpu.sr & ADDITIONAL_INFO_FLAG);
+}
+
+HANDLER(HREQ)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.counters.bus(BUS_REQUEST);
+    cpu.emem->request(op.memory ? op.address : op.value, cpu.sr & ADDITIONAL_INFO_FLAG, true);
+}
+
+// Devices take whole words, so a write has no high half to select and
+// HWRITE does the same as WRITE. Only HREQ differs from REQ, in the type of
+// the response
+HANDLER(HWRITE)
+{
+    exec<WRITE>(cpu, ins, op);
+}
+
+// Synchronous read, the data goes in R1 like in the EINR handler
+HANDLER(READ)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.counters.bus(BUS_READ);
+    cpu.reg[1] = cpu.bus_read(op.memory ? op.address : op.value, cpu.sr & ADDITIONAL_INFO_FLAG);
+}
+
+HANDLER(PAREQ)
+{
+    cpu.sr |= ADDITIONAL_INFO_FLAG;
+}
+
+HANDLER(CAREQ)
+{
+    cpu.sr &= ~ADDITIONAL_INFO_FLAG;
+}
+
+HANDLER(CMP)
+{
+    uint16_t a = cpu.reg[ins.x1];
+    uint16_t b = cpu.load_value(op);
+    cpu.set_arithmetic(FLAGS_SUB, a, b, a - b, op.size);
+}
+
+#define JUMP_IF(condition)                            \
+    if (condition)                                    \
+        cpu.pc = op.memory ? op.address : op.value
+
+HANDLER(JMP)
+{
+    JUMP_IF(true);
+}
+
+HANDLER(JEQ)
+{
+    JUMP_IF(cpu.flag_z());
+}
+
+HANDLER(JNE)
+{
+    JUMP_IF(!cpu.flag_z());
+}
+
+HANDLER(JGE)
+{
+    JUMP_IF(cpu.flag_n() == cpu.flag_o());
+}
+
+HANDLER(JGR)
+{
+    JUMP_IF(cpu.flag_n() == cpu.flag_o() && !cpu.flag_z());
+}
+
+// The specification says N != O and Z, but less or equal is either condition
+HANDLER(JLE)
+{
+    JUMP_IF(cpu.flag_n() != cpu.flag_o() || cpu.flag_z());
+}
+
+HANDLER(JLS)
+{
+    JUMP_IF(cpu.flag_n() != cpu.flag_o());
+}
+
+HANDLER(JO)
+{
+    JUMP_IF(cpu.flag_o());
+}
+
+HANDLER(JNO)
+{
+    JUMP_IF(!cpu.flag_o());
+}
+
+HANDLER(JN)
+{
+    JUMP_IF(cpu.flag_n());
+}
+
+HANDLER(JNN)
+{
+    JUMP_IF(!cpu.flag_n());
+}
+
+#undef JUMP_IF
+
+HANDLER(INC)
+{
+    uint16_t result = op.value + 1;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_arithmetic(FLAGS_ADD, op.value, 1, result, op.size);
+}
+
+HANDLER(DEC)
+{
+    uint16_t result = op.value - 1;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_arithmetic(FLAGS_SUB, op.value, 1, result, op.size);
+}
+
+HANDLER(ADD)
+{
+    uint16_t a = cpu.reg[ins.x1];
+    uint16_t b = cpu.load_value(op);
+    uint16_t result = a + b;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_arithmetic(FLAGS_ADD, a, b, result, op.size);
+}
+
+HANDLER(SUB)
+{
+    uint16_t a = cpu.reg[ins.x1];
+    uint16_t b = cpu.load_value(op);
+    uint16_t result = a - b;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_arithmetic(FLAGS_SUB, a, b, result, op.size);
+}
+
+HANDLER(NEG)
+{
+    uint16_t result = -op.value;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_arithmetic(FLAGS_SUB, 0, op.value, result, op.size);
+}
+
+HANDLER(AND)
+{
+    uint16_t result = cpu.reg[ins.x1] & cpu.load_value(op);
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_nz(result, op.size);
+}
+
+HANDLER(OR)
+{
+    uint16_t result = cpu.reg[ins.x1] | cpu.load_value(op);
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_nz(result, op.size);
+}
+
+HANDLER(XOR)
+{
+    uint16_t result = cpu.reg[ins.x1] ^ cpu.load_value(op);
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_nz(result, op.size);
+}
+
+HANDLER(NOT)
+{
+    uint16_t result = ~op.value;
+    cpu.set_register(ins.x1, result, op.size);
+    cpu.set_nz(result, op.size);
+}
+
+HANDLER(SIGN)
+{
+    uint16_t value = cpu.load_value(op);
+    cpu.materialize_flags();
+    if (value & SIGN_BIT(op.size))
+        cpu.sr |= NEGATIVE_FLAG;
+    else
+        cpu.sr &= ~NEGATIVE_FLAG;
+}
+
+// The carry holds the last bit shifted out, it is left alone when the
+// shift count is 0
+HANDLER(SHL)
+{
+    uint16_t value = cpu.reg[ins.x1] & SIZE_MASK(op.size);
+    uint16_t count = cpu.load_value(op);
+    uint16_t bits = op.size * 8;
+    cpu.materialize_flags();
+    if (count > 0)
+    {
+        bool carry = count <= bits && (value >> (bits - count)) & 1;
+        value = count < bits ? value << count : 0;
+        cpu.sr = carry ? cpu.sr | CARRY_FLAG : cpu.sr & ~CARRY_FLAG;
+    }
+    cpu.set_register(ins.x1, value, op.size);
+    cpu.set_nz(value, op.size);
+}
+
+HANDLER(SHR)
+{
+    uint16_t value = cpu.reg[ins.x1] & SIZE_MASK(op.size);
+    uint16_t count = cpu.load_value(op);
+    uint16_t bits = op.size * 8;
+    cpu.materialize_flags();
+    if (count > 0)
+    {
+        bool carry = count <= bits && (value >> (count - 1)) & 1;
+        value = count < bits ? value >> count : 0;
+        cpu.sr = carry ? cpu.sr | CARRY_FLAG : cpu.sr & ~CARRY_FLAG;
+    }
+    cpu.set_register(ins.x1, value, op.size);
+    cpu.set_nz(value, op.size);
+}
+
+HANDLER(PAR)
+{
+    uint16_t value = cpu.load_value(op) & SIZE_MASK(op.size);
+    cpu.materialize_flags();
+    if (__builtin_popcount(value) % 2 == 0)
+        cpu.sr |= ZERO_FLAG;
+    else
+        cpu.sr &= ~ZERO_FLAG;
+}
+
+HANDLER(LOAD)
+{
+    uint16_t value = cpu.load_value(op);
+    cpu.set_register(ins.x1, value, op.size);
+    cpu.set_nz(value, op.size);
+}
+
+HANDLER(STORE)
+{
+    if (!op.memory)
+        return;
+    if (op.size == BYTE_S)
+        cpu.write_byte(op.address, cpu.store_value(ins, op));
+    else
+        cpu.write_word(op.address, cpu.store_value(ins, op));
+}
+
+HANDLER(TRAN)
+{
+    cpu.reg[ins.x1] = cpu.reg[ins.x2];
+    cpu.set_nz(cpu.reg[ins.x1], WORD_S);
+}
+
+HANDLER(SWAP)
+{
+    std::swap(cpu.reg[ins.x1], cpu.reg[ins.x2]);
+}
+
+// Without system privileges only the condition codes can be loaded
+HANDLER(LDSR)
+{
+    uint8_t value = op.memory ? cpu.read_byte(op.address) : op.value;
+    uint8_t sr = cpu.get_sr();
+    if (!(sr & SYSTEM_PRIVILEGES_FLAG))
+        value = (value & ~(INTERRPUTS_FLAG | TIMER_INTERRUPT_FLAG | SYSTEM_PRIVILEGES_FLAG)) |
+                (sr & (INTERRPUTS_FLAG | TIMER_INTERRUPT_FLAG | SYSTEM_PRIVILEGES_FLAG));
+    cpu.set_sr(value);
+}
+
+HANDLER(LDSP)
+{
+    cpu.sp = op.memory ? cpu.read_word(op.address) : op.value;
+}
+
+HANDLER(LDBP)
+{
+    cpu.bp = op.memory ? cpu.read_word(op.address) : op.value;
+}
+
+HANDLER(STSR)
+{
+    cpu.write_byte(op.address, cpu.get_sr());
+}
+
+HANDLER(STSP)
+{
+    cpu.write_word(op.address, cpu.sp);
+}
+
+HANDLER(STBP)
+{
+    cpu.write_word(op.address, cpu.bp);
+}
+
+HANDLER(TRSR)
+{
+    cpu.reg[ins.x1] = cpu.get_sr();
+}
+
+HANDLER(TRSP)
+{
+    cpu.reg[ins.x1] = cpu.sp;
+}
+
+HANDLER(TRBP)
+{
+    cpu.reg[ins.x1] = cpu.bp;
+}
+
+// The MTU registers are only stored for now, in the same order as the
+// instructions: ILI, IHI, ELI, EHI, BP, TP
+#define MTU_SET(opcode, index)                 \
+    HANDLER(opcode)                            \
+    {                                          \
+        CHECK_SYSTEM_PRIVILEGES();             \
+        cpu.mtu[index] = cpu.load_value(op);   \
     }
 
-inline int8_t ANC216::CPU::get_lower(int16_t val)
+#define MTU_TRANSFER(opcode, index)            \
+    HANDLER(opcode)                            \
+    {                                          \
+        cpu.reg[ins.x1] = cpu.mtu[index];      \
+    }
+
+MTU_SET(SILI, 0)
+MTU_SET(SIHI, 1)
+MTU_SET(SELI, 2)
+MTU_SET(SEHI, 3)
+MTU_SET(SBP, 4)
+MTU_SET(STP, 5)
+MTU_TRANSFER(TILI, 0)
+MTU_TRANSFER(TIHI, 1)
+MTU_TRANSFER(TELI, 2)
+MTU_TRANSFER(TEHI, 3)
+MTU_TRANSFER(TBP, 4)
+MTU_TRANSFER(TTP, 5)
+
+#undef MTU_SET
+#undef MTU_TRANSFER
+
+HANDLER(LCPID)
+{
+    CHECK_SYSTEM_PRIVILEGES();
+    cpu.cpid = cpu.load_value(op);
+}
+
+HANDLER(TCPID)
+{
+    cpu.reg[ins.x1] = cpu.cpid;
+}
+
+HANDLER(TIME)
+{
+    cpu.timer.set_period(op.memory ? cpu.read_word(op.address) : op.value);
+}
+
+HANDLER(TSTART)
+{
+    cpu.timer.start(cpu.cycles);
+    cpu.sync_events();
+}
+
+HANDLER(TSTOP)
+{
+    cpu.timer.stop();
+}
+
+// Milliseconds left before the timer expires
+HANDLER(TRT)
+{
+    cpu.reg[ins.x1] = cpu.timer.remaining(cpu.cycles);
+}
+
+#undef HANDLER
+
+constexpr std::array<ANC216::Handler, 256> ANC216::CPU::handlers = []<std::size_t... OPCODE>(std::index_sequence<OPCODE...>)
+{
+    return std::array<Handler, 256>{&exec<OPCODE>...};
+}(std::make_index_sequence<256>{});
+
+// The block engine runs one function per opcode and addressing mode, with
+// the fetch of the mode and the handler of the opcode inlined in it. The
+// operand is resolved by code specialized for its mode, and an instruction
+// costs a single indirect call instead of two. Operands relative to pc
+// were resolved when the block was translated
+template <uint8_t OPCODE, ANC216::AddressingMode MODE>
+void ANC216::CPU::block_step(CPU &cpu, const BlockInstruction &bi)
+{
+    Operand op;
+    if constexpr (MODE == MEMORY_RELATIVE_TO_PC || MODE == MEMORY_RELATIVE_TO_PC_TO_REGISTER)
+        op = {0, bi.address, WORD_S, true};
+    else if constexpr (MODE == MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER)
+        op = {0, bi.address, BYTE_S, true};
+    else
+        fetch<MODE>(cpu, bi.ins, op);
+    exec<OPCODE>(cpu, bi.ins, op);
+}
+
+// Indexed by opcode * (NONE + 1) + mode. The opcodes past TRT all share
+// the step of an unknown opcode, they only raise the NMI
+constexpr std::array<ANC216::BlockStep, 256 * (ANC216::NONE + 1)> ANC216::CPU::block_steps = []<std::size_t... OPCODE>(std::index_sequence<OPCODE...>)
 {
-    return val & 0xFF;
-}
+    std::array<BlockStep, 256 * (NONE + 1)> table{};
+    auto modes = []<uint8_t OP, std::size_t... MODE>(std::index_sequence<MODE...>)
+    {
+        return std::array<BlockStep, NONE + 1>{&block_step<OP, (AddressingMode)MODE>...};
+    };
+    std::array<BlockStep, NONE + 1> rows[] = {modes.template operator()<OPCODE>(std::make_index_sequence<NONE + 1>{})...};
+    for (size_t opcode = 0; opcode < 256; opcode++)
+        for (size_t mode = 0; mode <= NONE; mode++)
+            table[opcode * (NONE + 1) + mode] = opcode <= TRT ? rows[opcode][mode] : &block_step<0xFF, IMPLIED_MODE>;
+    return table;
+}(std::make_index_sequence<TRT + 1>{});
 
-inline void ANC216::CPU::fetch_instruction()
+void ANC216::CPU::decode(uint16_t address, DecodedInstruction &ins)
 {
-    current_instruction = imem[pc += 2];
-    get_addressing_mode();
+    const AddressingInfo &info = addressing_table[imem[address]];
+    uint8_t opcode = imem[(uint16_t)(address + 1)];
+    uint8_t first = info.argsize - info.immsize;
+    uint16_t args = address + 2;
+
+    ins.handler = handlers[opcode];
+    ins.fetch = info.fetch;
+    // Straight from imem, decoding isn't a data read for the statistics
+    auto word = [this](uint16_t at)
+    { return (uint16_t)(imem[at] << 8 | imem[(uint16_t)(at + 1)]); };
+    ins.arg = first == 2 ? word(args) : first == 1 ? imem[args] : 0;
+    args += first;
+    ins.arg2 = info.immsize == 2 ? word(args) : info.immsize == 1 ? imem[args] : 0;
+    ins.instruction = imem[address] << 8 | opcode;
+    ins.mode = info.mode;
+    ins.immsize = info.immsize;
+    ins.x1 = info.x1;
+    ins.x2 = info.x2;
+    ins.length = 2 + info.argsize;
+    ins.cycles = instruction_cycles(opcode) + info.argsize + addressing_cycles(info.mode);
+    ins.valid = true;
 }
 
-inline void ANC216::CPU::get_addressing_mode()
+// In fast mode the BIOS services are provided by the host
+inline void ANC216::CPU::host_syscall()
 {
-    uint8_t addr = current_instruction >> 8;
-    if (addr == 0)
-    {
-        current_addressing_mode = IMPLIED_MODE;
-        argsize = 0;
-    }
-    else if (addr == 0b00'001'000)
-    {
-        current_addressing_mode = IMMEDIATE_BYTE;
-        argsize = 1;
-    }
-    else if (addr == 0b00'010'000)
-    {
-        current_addressing_mode = IMMEDIATE_WORD;
-        argsize = 2;
-    }
-    else if ((addr & 0b11'000'111) == 0b00'000'001)
-    {
-        current_addressing_mode = REGISTER_ACCESS_MODE;
-        argsize = 2;
-    }
-    else if ((addr & 0b11'000'111) == 0b00'000'010)
-    {
-        current_addressing_mode = LOW_REGISTER_ACCESS_MODE;
-        argsize = 1;
-    }
-    else if ((addr & 0b11'000'000) == 0b01'000'000)
-    {
-        current_addressing_mode = REGISTER_TO_REGISTER_MODE;
-        argsize = 0;
-    }
-    else if (addr == 0b10'000'000)
-    {
-        current_addressing_mode = MEMORY_ABSOULTE;
-        argsize = 2;
-    }
-    else if ((addr & 0b11'000'111) == 0b10'000'001)
-    {
-        current_addressing_mode = MEMORY_ABSOULTE_INDEXED;
-        argsize = 2;
-    }
-    else if (addr == 0b10'000'100)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_PC;
-        argsize = 1;
-    }
-    else if (addr == 0b10'001'100)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_BP;
-        argsize = 1;
-    }
-    else if ((addr & 0b11'000'111) == 0b10'000'101)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_PC_WITH_REGISTER;
-        argsize = 0;
-    }
-    else if ((addr & 0b11'000'111) == 0b10'000'110)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_BP_WITH_REGISTER;
-        argsize = 0;
-    }
-    else if (addr == 0b10'000'010)
-    {
-        current_addressing_mode = MEMORY_INDIRECT;
-        argsize = 2;
-    }
-    else if ((addr & 0b11'000'111) == 0b10'000'011)
-    {
-        current_addressing_mode = MEMORY_INDIRECT_INDEXED;
-        argsize = 2;
-    }
-    else if (addr == 0b11)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP;
-        argsize = 1;
-    }
-    else if (addr == 0b1011)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP;
-        argsize = 2;
-    }
-    else if ((addr & 0b11'000'111) == 0b00'000'100)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER;
-        argsize = 1;
-    }
-    else if ((addr & 0b11'000'111) == 0b00'000'101)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER;
-        argsize = 2;
-    }
-    else if (addr == 0b110)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_ABSOLUTE;
-        argsize = 3;
-    }
-    else if (addr == 0b1110)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_ABSOLUTE;
-        argsize = 4;
-    }
-    else if ((addr & 0b11'000'111) == 0b111)
-    {
-        current_addressing_mode = IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED;
-        argsize = 1;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'000)
-    {
-        current_addressing_mode = MEMORY_ABSOULTE_TO_REGISTER;
-        argsize = 2;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'001)
-    {
-        current_addressing_mode = IMMEDIATE_TO_REGISTER;
-        argsize = 2;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'010)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_PC_TO_REGISTER;
-        argsize = 1;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'011)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_BP_TO_REGISTER;
-        argsize = 1;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'100)
-    {
-        current_addressing_mode = MEMORY_ABSOULTE_TO_LOW_REGISTER;
-        argsize = 2;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'101)
+    switch (reg[0] & 0xFF)
     {
-        current_addressing_mode = IMMEDIATE_TO_LOW_REGISTER;
-        argsize = 1;
-    }
-    else if ((addr & X1_REG_MASK) == 0b11'000'110)
+    case SYSCALL_EXIT:
+        reg[0] = reg[1];
+        killed = true;
+        end_slice();
+        break;
+    case SYSCALL_PRINT:
     {
-        current_addressing_mode = MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER;
-        argsize = 1;
+        std::ostream &stream = (reg[3] & 0xFF) == 1 ? *err : *out;
+        for (uint16_t i = 0; i < (uint16_t)reg[2]; i++)
+            stream.put(imem[(uint16_t)(reg[1] + i)]);
+        break;
     }
-    else if ((addr & X1_REG_MASK) == 0b11'000'111)
-    {
-        current_addressing_mode = MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER;
-        argsize = 1;
     }
+}
+
+// Reads through the history while it records or replays, so replaying
+// gives back the values the devices returned the first time
+inline uint16_t ANC216::CPU::bus_read(uint16_t address, bool additional_flag)
+{
+    if (history != nullptr)
+        return history->read(address, additional_flag);
+    return emem->read(address, additional_flag);
+}
 
-    if (argsize == 1)
-        arg = imem[pc + 1];
-    if (argsize == 2)
-        arg = imem[pc + 1] << 8 | imem[pc + 2];
+inline void ANC216::CPU::nmi(uint8_t code)
+{
+    nmi_code = code;
+    interrupt(NMI_INTERRUPT);
 }
 
-inline void ANC216::CPU::store_data()
+// Raised by the instruction being executed: the current run stops after it
+// so the interrupt is taken before the next instruction
+inline void ANC216::CPU::interrupt(uint8_t source)
 {
+    pending_interrupts.fetch_or(source, std::memory_order_release);
+    run_end = cycles;
+    exit_block = true;
 }
 
-inline void ANC216::CPU::load_reg(uint16_t val)
+// The standard interrupt procedure: the interrupted SP is saved at
+// SAVED_SP_ADDR, PC, SR and BP are pushed at the bottom of the system stack
+// and the handler runs above them with BP at INTERRUPT_BP, system
+// privileges and interrupts disabled. The registers pushed after them by
+// some interrupts are restored by the handler
+inline void ANC216::CPU::enter_interrupt(uint16_t vector)
 {
-    reg[X1_GET_REG((current_instruction >> 8))] = val;
+    uint8_t status = get_sr();
+    cycles += interrupt_cycles;
+    write_word(SAVED_SP_ADDR, sp);
+    sp = read_word(SYSTEM_SP_ADDR);
+    push_word(pc);
+    push_byte(status);
+    push_word(bp);
+    bp = INTERRUPT_BP;
+    set_sr((status | SYSTEM_PRIVILEGES_FLAG) & ~INTERRPUTS_FLAG);
+    pc = read_word(vector);
 }
-//              <bytes  , value   >
-inline std::pair<uint8_t, uint16_t> ANC216::CPU::fetch_data()
+
+// RET at the end of a handler: the interrupted code gets its PC, SR, BP and
+// SP back, wherever the handler left SP
+inline void ANC216::CPU::leave_interrupt()
 {
-    switch (current_addressing_mode)
-    {
-    case IMMEDIATE_BYTE:
-        return {1, imem[pc++]};
-    case IMMEDIATE_WORD:
-        return {2, imem[pc++] << 8 | imem[pc++]};
-    case REGISTER_ACCESS_MODE:
-        return {2, reg[X1_GET_REG(current_addressing_mode)]};
-    case MEMORY_ABSOULTE:
-    case MEMORY_INDIRECT:
-        return {2, imem[imem[pc++] << 8 | imem[pc++]]};
-    case MEMORY_ABSOULTE_INDEXED:
-    case MEMORY_INDIRECT_INDEXED:
-        return {2, imem[(imem[pc++] << 8 | imem[pc++]) + (int8_t)reg[X1_GET_REG(current_addressing_mode)]]};
-    case MEMORY_RELATIVE_TO_PC:
-        return {1, imem[pc + (int8_t)imem[pc++]]};
-    case MEMORY_RELATIVE_TO_PC_WITH_REGISTER:
-        return {1, imem[pc + (int8_t)reg[X1_GET_REG(current_addressing_mode)]]};
-    case MEMORY_RELATIVE_TO_BP:
-        return {1, imem[bp + (int8_t)imem[pc++]]};
-    case MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
-        return {1, imem[bp + (int8_t)reg[X1_GET_REG(current_addressing_mode)]]};
-    case IMMEDIATE_TO_MEMORY_ABSOLUTE:
-        pc += 2;
-        if (argsize == 4)
-            return {2, imem[pc++] << 8 | imem[pc++]};
-        return {1, imem[pc++]};
-    case IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED:
-        pc += 2;
-        if (argsize == 4)
-            return {2, imem[pc++] << 8 | imem[pc++]};
-        return {1, imem[pc++]};
-    case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP:
-        pc += 1;
-        if (argsize == 3)
-            return {2, imem[pc++] << 8 | imem[pc++]};
-        return {1, imem[pc++]};
-    case IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER:
-        if (argsize == 2)
-            return {2, imem[pc++] << 8 | imem[pc++]};
-        return {1, imem[pc++]};
-    case REGISTER_TO_MEMORY_ABSOULTE:
-        pc += 2;
-    case MEMORY_ABSOULTE_TO_REGISTER:
-    case IMMEDIATE_TO_REGISTER:
-    case REGISTER_TO_MEMORY_RELATIVE_TO_PC:
-    case MEMORY_RELATIVE_TO_PC_TO_REGISTER:
-    case REGISTER_TO_MEMORY_RELATIVE_TO_BP:
-    case MEMORY_RELATIVE_TO_BP_TO_REGISTER:
-    case LOW_REGISTER_TO_MEMORY_ABSOLUTE:
-    case MEMORY_ABSOULTE_TO_LOW_REGISTER:
-    case IMMEDIATE_TO_LOW_REGISTER:
-    case LOW_REGISTER_TO_MEMORY_RELATIVE_TO_PC:
-    case MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER:
-    case LOW_REGISTER_TO_MEMORY_RELATIVE_TO_BP:
-    case MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER:
-    case NONE:
-    default:
-        return {1, 0};
-    }
+    sp = read_word(SYSTEM_SP_ADDR) + INTERRUPT_FRAME_SIZE;
+    bp = pop_word();
+    set_sr(pop_byte());
+    pc = pop_word();
+    sp = read_word(SAVED_SP_ADDR);
 }
 
-inline void ANC216::CPU::nmi()
+// Takes the highest priority interrupt that isn't masked. NMI and SYSCALL
+// can't be masked, the timer needs both I and T, bus responses need I
+void ANC216::CPU::service_interrupts()
 {
+    uint8_t pending = pending_interrupts.load(std::memory_order_acquire);
+    uint8_t status = get_sr();
+    uint8_t source;
+    BusResponse response = {};
+
+    if (pending & NMI_INTERRUPT)
+        source = NMI_INTERRUPT;
+    else if (pending & SYSCALL_INTERRUPT)
+        source = SYSCALL_INTERRUPT;
+    else if (!(status & INTERRPUTS_FLAG))
+        return;
+    else if (pending & TIMER_INTERRUPT && status & TIMER_INTERRUPT_FLAG)
+        source = TIMER_INTERRUPT;
+    else if (pending & EINR_INTERRUPT)
+    {
+        // Cleared before taking a response, a device answering meanwhile
+        // sets it again
+        pending_interrupts.fetch_and(~EINR_INTERRUPT);
+        if (!emem->next_response(response))
+            return;
+        pending_interrupts.fetch_or(EINR_INTERRUPT);
+        source = EINR_INTERRUPT;
+    }
+    else
+        return;
 
+    if (tracer != nullptr)
+    {
+        tracer->before_interrupt(source, status);
+        take_interrupt(source, response);
+        tracer->after(get_sr());
+    }
+    else
+        take_interrupt(source, response);
+    if (profiler != nullptr)
+        profiler->enter_interrupt();
+    if (history != nullptr)
+        history->log_interrupt(source, response);
 }
 
-inline void ANC216::CPU::execute()
+void ANC216::CPU::take_interrupt(uint8_t source, const BusResponse &response)
 {
-    uint8_t ins = current_instruction & 0xFF;
-    std::pair<uint8_t, uint16_t> data = fetch_data();
-    switch (ins)
+    switch (source)
     {
-    case KILL:
-        killed = true;
+    case NMI_INTERRUPT:
+        pending_interrupts.fetch_and(~NMI_INTERRUPT);
+        enter_interrupt(NMI_VECTOR);
+        push_word(reg[0]);
+        reg[0] = nmi_code;
         break;
-    case RESETI:
-        load_init_state();
+    case SYSCALL_INTERRUPT:
+        pending_interrupts.fetch_and(~SYSCALL_INTERRUPT);
+        enter_interrupt(SYSCALL_VECTOR);
         break;
-    case CPUID:
-        reg[0] = (int16_t)0x8000;
+    case TIMER_INTERRUPT:
+        pending_interrupts.fetch_and(~TIMER_INTERRUPT);
+        enter_interrupt(TIMER_VECTOR);
         break;
-    case SYSCALL:
+    case EINR_INTERRUPT:
+        enter_interrupt(EINR_VECTOR);
+        push_word(reg[0]);
+        push_word(reg[1]);
+        push_byte(reg[2] & 0xFF);
+        reg[0] = response.address;
+        reg[1] = response.data;
+        set_register(2, response.type, BYTE_S);
+        counters.bus(BUS_RESPONSE);
+        break;
+    }
+}
 
-    case CALL:
+inline void ANC216::CPU::execute()
+{
+    DecodedInstruction &ins = decode_cache[pc];
+    if (!ins.valid)
+        decode(pc, ins);
 
-    case RET:
-        sr = imem[sp - 1];
-        pc = imem[sp - 2] << 8 | imem[sp - 3];
-        sp = bp;
-        break;
-    case PUSH:
-        if (data.first == BYTE_S)
-        {
-            imem[sp] = static_cast<uint8_t>(data.second);
-            sp++;
-        }
+    Operand op;
+    current_instruction = ins.instruction;
+    pc += ins.length;
+    uint16_t next_pc = pc;
+    cycles += ins.cycles;
+    instructions++;
+    ins.fetch(*this, ins, op);
+    ins.handler(*this, ins, op);
+    count(ins, next_pc);
+}
+
+
+// A single instruction and the events it makes due, used by the history
+// to replay the execution
+void ANC216::CPU::replay_instruction()
+{
+    execute();
+    emem->flush();
+    scheduler.run_due(cycles);
+}
+
+// Straight-line code runs up to the next scheduled event or the end of the
+// slice, whichever comes first, then the events that are due fire
+inline void ANC216::CPU::run_slice()
+{
+    while (cycles < slice_end)
+    {
+        if (pending_interrupts.load(std::memory_order_relaxed))
+            service_interrupts();
+        run_end = std::min(slice_end, scheduler.next_due());
+        if (debugger != nullptr && debugger->active())
+            run_checked();
+        else if (tracer != nullptr || profiler != nullptr)
+            run_instrumented();
+        else if (blocks != nullptr)
+            blocks->run();
         else
+            while (cycles < run_end)
+                execute();
+        // Batched writes reach their device before its events
+        emem->flush();
+        scheduler.run_due(cycles);
+    }
+}
+
+// The interpreter loop used while breakpoints, watchpoints or nj/nr are set.
+// Stopping leaves running false, the console starts the machine again
+inline void ANC216::CPU::run_checked()
+{
+    uint32_t skip = debugger->take_resume_pc();
+    while (cycles < run_end)
+    {
+        if (debugger->should_stop(pc, skip))
         {
-            imem[sp] = data.second >> 8;
-            imem[sp + (uint16_t)1] = static_cast<uint8_t>(data.second);
-            sp += 2;
-        }
-    case POP:
-        if (current_addressing_mode == LOW_REGISTER_ACCESS_MODE)
-        {
-            sp--;
-            load_reg(imem[sp]);
+            running = false;
+            end_slice();
+            return;
         }
+        skip = NO_PC;
+        if (tracer != nullptr || profiler != nullptr)
+            instrumented_execute();
         else
+            execute();
+        if (debugger->should_stop_after(current_instruction & 0xFF))
         {
-            sp -= 2;
-            load_reg(imem[sp] << 8 | imem[sp + 1]);
+            running = false;
+            end_slice();
+            return;
         }
-        break;
-    case PHPC:
-        imem[sp] = pc >> 8;
-        imem[sp + (uint16_t)1] = static_cast<uint8_t>(pc);
-        sp += 2;
-        break;
-    case POPC:
-        pc = imem[sp - 1] << 8 | imem[sp - 2];
-        sp -= 2;
-        break;
-    case PHSR:
-        imem[sp] = sr;
-        sp++;
-        break;
-    case POSR:
-        sr = imem[sp - 1];
-        sp--;
-        break;
-    case PHSP:
-        imem[sp] = sp >> 8;
-        imem[sp + (uint16_t)1] = static_cast<uint8_t>(sp);
-        sp += 2;
-        break;
-    case POSP:
-        sp = imem[sp - 1] << 8 | imem[sp - 2];
-        break;
-    case PHBP:
-        imem[sp] = bp >> 8;
-        imem[sp + (uint16_t)1] = static_cast<uint8_t>(bp);
-        sp += 2;
-        break;
-    case POBP:
-        bp = imem[sp - 1] << 8 | imem[sp - 2];
-        sp -= 2;
-        break;
-    case SETI:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr |= INTERRPUTS_FLAG;
-        break;
-    case SETT:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr |= TIMER_INTERRUPT_FLAG;
-        break;
-    case SETS:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr |= SYSTEM_PRIVILEGES_FLAG;
-        break;
-    case CLRI:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr &= ~INTERRPUTS_FLAG;
-        break;
-    case CLRT:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr &= ~TIMER_INTERRUPT_FLAG;
-        break;
-    case CLRS:
-        CHECK_SYSTEM_PRIVILEGES();
-        sr &= ~SYSTEM_PRIVILEGES_FLAG;
-        break;
-    case CLRN:
-        sr &= ~NEGATIVE_FLAG;
-        break;
-    case CLRO:
-        sr &= ~OVERFLOW_FLAG;
-        break;
-    case CLRC:
-        sr &= ~CARRY_FLAG;
-        break;
-    case IREQ:
-        CHECK_SYSTEM_PRIVILEGES();
-        if (current_addressing_mode == REGISTER_ACCESS_MODE)
-            emem->info_req(data.second);
-        else
-            emem->info_req(arg);
-        break;
-    case REQ:
-        CHECK_SYSTEM_PRIVILEGES();
-    case WRITE:
-    case HREQ:
-    case HWRITE:
-    case READ:
-    case PAREQ:
-    case CMP:
-    case CAREQ:
-    case JMP:
-    case JEQ:
-    case JNE:
-    case JGE:
-    case JGR:
-    case JLE:
-    case JLS:
-    case JO:
-    case JNO:
-    case JN:
-    case JNN:
-    case INC:
-    case DEC:
-    case ADD:
-    case SUB:
-    case NEG:
-    case AND:
-    case OR:
-    case XOR:
-    case NOT:
-    case SIGN:
-    case SHL:
-    case SHR:
-    case PAR:
-    case LOAD:
-    case STORE:
-    case TRAN:
-    case SWAP:
-    case LDSR:
-    case LDSP:
-    case LDBP:
-    case STSR:
-    case STSP:
-    case STBP:
-    case TRSR:
-    case TRSP:
-    case TRBP:
-    case SILI:
-    case SIHI:
-    case SELI:
-    case SEHI:
-    case SBP:
-    case STP:
-    case TILI:
-    case TIHI:
-    case TELI:
-    case TEHI:
-    case TBP:
-    case TTP:
-    case LCPID:
-    case TCPID:
-    case TIME:
-    case TSTART:
-    case TSTOP:
-    case TRT:
-        return;
     }
 }
 
-ANC216::CPU::CPU(EmemMapper *mapper, const EmuFlags &flags) : flags(flags)
+// The interpreter loop used with --trace or --profile, the block engine is
+// bypassed so they see every instruction
+inline void ANC216::CPU::run_instrumented()
+{
+    while (cycles < run_end)
+        instrumented_execute();
+}
+
+inline void ANC216::CPU::instrumented_execute()
+{
+    // Where it continues without jumping, for the profiler
+    DecodedInstruction &ins = decode_cache[pc];
+    if (!ins.valid)
+        decode(pc, ins);
+    uint16_t next_pc = pc + ins.length;
+    if (tracer != nullptr)
+        tracer->before_instruction(get_sr());
+    execute();
+    if (tracer != nullptr)
+        tracer->after(get_sr());
+    if (profiler != nullptr)
+        profiler->after_instruction(current_instruction & 0xFF, pc != next_pc);
+}
+
+inline void ANC216::CPU::end_slice()
+{
+    slice_end = cycles;
+    run_end = cycles;
+    exit_block = true;
+}
+
+// Called after an instruction schedules an event, which may be due before
+// the point the current run was going to stop at. The block engine checks
+// that point again
+inline void ANC216::CPU::sync_events()
+{
+    uint64_t due = scheduler.next_due();
+    if (due >= run_end)
+        return;
+    run_end = due;
+    exit_block = true;
+}
+
+ANC216::CPU::CPU(EmemMapper *mapper, const EmuFlags &flags) : timer(scheduler, [this]
+                                                                       { timer_expired(); }),
+                                                                 flags(flags)
 {
     this->emem = mapper;
+    std::fill(dirty_pages, dirty_pages + PAGES, true);
+    if (flags.block_engine)
+        blocks = new BlockEngine(*this);
+    if (flags.debug_mode)
+        debugger = new Debugger(*this);
+    if (flags.debug_mode && flags.history_size > 0)
+        history = new History(*this, flags.history_size, flags.checkpoint_interval);
     if (flags.debug_mode)
         running = false;
     else
         running = true;
     load_init_state();
-    thread = new std::thread([this]
-                       { this->_cycle(); });
+    publish();
 }
 
 ANC216::CPU::~CPU()
 {
-    delete this->imem;
+    delete[] this->imem;
+    delete[] this->decode_cache;
+    delete this->blocks;
+    delete this->history;
+    delete this->debugger;
+    delete this->tracer;
+    delete this->profiler;
 }
 
 inline void ANC216::CPU::load_init_state()
 {
     pc = ROM_ADDR;
-    sr = 0b00111100;
+    set_sr(0b00111100);
+}
+
+void ANC216::CPU::launch()
+{
+    thread = new std::thread([this]
+                             { this->_cycle(); });
+}
+
+void ANC216::CPU::run()
+{
+    _cycle();
+}
+
+void ANC216::CPU::load_memory(uint16_t address, const std::vector<uint8_t> &data)
+{
+    for (size_t i = 0; i < data.size(); i++)
+        imem[(uint16_t)(address + i)] = data[i];
+    std::fill(dirty_pages, dirty_pages + PAGES, true);
+    flush_decode_cache();
+    publish();
+}
+
+bool ANC216::CPU::budget_exceeded()
+{
+    return out_of_budget;
 }
 
 void ANC216::CPU::wait()
@@ -509,43 +1484,341 @@ uint16_t ANC216::CPU::get_current_instruction()
     return current_instruction;
 }
 
+uint64_t ANC216::CPU::get_cycles()
+{
+    return cycles;
+}
+
+uint64_t ANC216::CPU::get_instructions()
+{
+    return instructions;
+}
+
 int16_t *ANC216::CPU::get_registers()
 {
     return reg;
 }
 
+// Instructions run in slices of flags.slice_cycles emulated cycles. The
+// thread only sleeps between slices, until the host time the slice should
+// take at the requested speed has passed
 inline void ANC216::CPU::_cycle()
 {
+    using clock = std::chrono::steady_clock;
+    auto deadline = clock::now();
+    auto timeout = deadline + std::chrono::milliseconds(flags.timeout);
+
     while (!killed)
     {
-        if (running)
+        if (!running)
         {
-            fetch_instruction();
-            execute();
-            std::this_thread::sleep_for(std::chrono::milliseconds((long long)(10 / this->flags.speed)));
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            deadline = clock::now();
+            continue;
+        }
+
+        uint64_t start = cycles;
+        run_for(flags.slice_cycles);
+        if (debugger != nullptr)
+            debugger->report(std::cout);
+
+        if (flags.timeout != 0 && clock::now() >= timeout)
+        {
+            out_of_budget = true;
+            killed = true;
         }
+
+        if (flags.max_speed)
+            continue;
+
+        deadline += std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>((cycles - start) / (CPU_CLOCK_HZ * (double)flags.speed)));
+        auto now = clock::now();
+        // Don't try to catch up after the host fell behind, e.g. while suspended
+        if (now - deadline > std::chrono::milliseconds(100))
+            deadline = now;
+        std::this_thread::sleep_until(deadline);
+    }
+    flush_trace();
+    try
+    {
+        write_profile();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << e.what() << std::endl;
+    }
+}
+
+// Runs one slice of at most slice emulated cycles on the calling thread,
+// without pacing. The instruction budget is checked after it
+void ANC216::CPU::run_for(uint64_t slice)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    // Stopped while waiting for the lock
+    if (!running || killed)
+        return;
+    if (history != nullptr)
+        history->record();
+    slice_end = cycles + slice;
+    run_slice();
+    emem->flush();
+    publish();
+
+    if (flags.max_instructions != 0 && instructions >= flags.max_instructions)
+    {
+        out_of_budget = true;
+        killed = true;
+    }
+}
+
+bool ANC216::CPU::is_killed()
+{
+    return killed;
+}
+
+// Where the guest output goes in fast mode, stdout and stderr by default
+void ANC216::CPU::set_output(std::ostream *out, std::ostream *err)
+{
+    this->out = out;
+    this->err = err;
+}
+
+// A bus response is waiting. Called by whichever thread answered, so it
+// only sets the pending bit
+void ANC216::CPU::einr()
+{
+    pending_interrupts.fetch_or(EINR_INTERRUPT, std::memory_order_release);
+}
+
+// For the devices, on the CPU thread. An event due before the end of the
+// current run shortens it
+ANC216::EventId ANC216::CPU::schedule_event(uint64_t when, EventAction action)
+{
+    EventId id = scheduler.schedule(when, std::move(action));
+    sync_events();
+    return id;
+}
+
+void ANC216::CPU::cancel_event(EventId id)
+{
+    scheduler.cancel(id);
+}
+
+// Expiries while timer interrupts are disabled are lost
+void ANC216::CPU::timer_expired()
+{
+    if (sr & TIMER_INTERRUPT_FLAG)
+        pending_interrupts.fetch_or(TIMER_INTERRUPT, std::memory_order_release);
+}
+
+// Makes the current state visible to get_info(). Called by the CPU thread
+// between slices, so readers never see the machine in the middle of an
+// instruction
+void ANC216::CPU::publish()
+{
+    CPUInfo info;
+    std::copy(reg, reg + 8, info.reg);
+    info.sr = get_sr();
+    info.sp = sp;
+    info.bp = bp;
+    info.pc = pc;
+    info.current_instruction = current_instruction;
+    info.cycles = cycles;
+    info.instructions = instructions;
+    snapshot.write(info);
+}
+
+ANC216::History *ANC216::CPU::get_history()
+{
+    return history;
+}
+
+ANC216::Debugger *ANC216::CPU::get_debugger()
+{
+    return debugger;
+}
+
+bool ANC216::CPU::is_running()
+{
+    return running;
+}
+
+std::vector<uint8_t> ANC216::CPU::read_memory(uint16_t address, uint16_t size)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    std::vector<uint8_t> data(size);
+    for (uint16_t i = 0; i < size; i++)
+        data[i] = imem[(uint16_t)(address + i)];
+    return data;
+}
+
+void ANC216::CPU::start_trace(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    delete tracer;
+    tracer = nullptr;
+    tracer = new Tracer(*this, filename);
+}
+
+// Writes out the trace recorded so far, called before the emulator exits
+void ANC216::CPU::flush_trace()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (tracer != nullptr)
+        tracer->flush();
+}
+
+void ANC216::CPU::start_profile(const std::string &filename, uint64_t interval, const std::string &symbols)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    Profiler *started = new Profiler(*this, filename, interval);
+    try
+    {
+        if (!symbols.empty())
+            started->load_symbols(symbols);
+    }
+    catch (...)
+    {
+        delete started;
+        throw;
     }
+    delete profiler;
+    profiler = started;
+}
+
+void ANC216::CPU::write_statistics(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    counters.write_json(out);
 }
 
-inline void ANC216::CPU::einr()
+void ANC216::CPU::write_profile()
 {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (profiler != nullptr)
+        profiler->write();
 }
 
 ANC216::CPUInfo ANC216::CPU::get_info()
 {
-    return CPUInfo{
-        this->reg,
-        this->sr,
-        this->sp,
-        this->bp,
-        this->pc,
-        this->current_instruction
-    };
+    return snapshot.read();
+}
+
+// Changes the registers, sr, sp, bp and pc between two slices. The
+// counters and the current instruction of info are left as they are
+void ANC216::CPU::set_state(const CPUInfo &info)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    std::copy(info.reg, info.reg + 8, reg);
+    set_sr(info.sr);
+    sp = info.sp;
+    bp = info.bp;
+    pc = info.pc;
+    publish();
 }
 
 void ANC216::CPU::step()
 {
     running = false;
-    fetch_instruction();
-    execute();
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (history != nullptr)
+        history->record();
+    if (debugger != nullptr)
+        debugger->clear_resume_pc();
+    if (tracer != nullptr || profiler != nullptr)
+        instrumented_execute();
+    else
+        execute();
+    emem->flush();
+    scheduler.run_due(cycles);
+    if (pending_interrupts.load(std::memory_order_relaxed))
+        service_interrupts();
+    emem->flush();
+    publish();
+}
+
+ANC216::Snapshot ANC216::CPU::take_snapshot()
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    Snapshot state = capture();
+    emem->save_state(state);
+    return state;
+}
+
+void ANC216::CPU::restore_snapshot(const Snapshot &state)
+{
+    std::lock_guard<std::mutex> lock(state_mutex);
+    emem->load_state(state);
+    restore(state);
+    if (history != nullptr)
+        history->clear();
+    publish();
+}
+
+// Only the pages written since the previous snapshot are copied, the
+// others are shared with it. Devices are not included
+ANC216::Snapshot ANC216::CPU::capture()
+{
+    Snapshot state;
+    std::copy(reg, reg + 8, state.reg);
+    state.sr = get_sr();
+    state.sp = sp;
+    state.bp = bp;
+    state.pc = pc;
+    state.current_instruction = current_instruction;
+    std::copy(mtu, mtu + 6, state.mtu);
+    state.cpid = cpid;
+    state.cycles = cycles;
+    state.instructions = instructions;
+    state.pending_interrupts = pending_interrupts;
+    state.nmi_code = nmi_code;
+    state.timer = timer.save_state();
+
+    for (size_t i = 0; i < PAGES; i++)
+    {
+        if (!dirty_pages[i])
+            continue;
+        auto page = std::make_shared<MemoryPage>();
+        std::memcpy(page->data(), imem + i * PAGE_SIZE, PAGE_SIZE);
+        snapshot_pages[i] = page;
+        dirty_pages[i] = false;
+    }
+    state.imem = snapshot_pages;
+    return state;
+}
+
+// Pages still shared with the snapshot and not written since are already
+// in place, only the others are copied back and their code invalidated.
+// Devices are left alone
+void ANC216::CPU::restore(const Snapshot &state)
+{
+    std::copy(state.reg, state.reg + 8, reg);
+    set_sr(state.sr);
+    sp = state.sp;
+    bp = state.bp;
+    pc = state.pc;
+    current_instruction = state.current_instruction;
+    std::copy(state.mtu, state.mtu + 6, mtu);
+    cpid = state.cpid;
+    cycles = state.cycles;
+    instructions = state.instructions;
+    pending_interrupts = state.pending_interrupts;
+    nmi_code = state.nmi_code;
+    scheduler.clear();
+    timer.load_state(state.timer);
+    emem->schedule_events();
+    if (profiler != nullptr)
+        profiler->clear_stack();
+
+    for (size_t i = 0; i < PAGES; i++)
+    {
+        if (!dirty_pages[i] && snapshot_pages[i] == state.imem[i])
+            continue;
+        std::memcpy(imem + i * PAGE_SIZE, state.imem[i]->data(), PAGE_SIZE);
+        for (size_t address = i * PAGE_SIZE; address < (i + 1) * PAGE_SIZE; address++)
+            invalidate(address);
+        dirty_pages[i] = false;
+    }
+    snapshot_pages = state.imem;
 }
@@ -1,26 +1,99 @@
 #include <debug.hh>
+#include <snapshot.hh>
+#include <history.hh>
+#include <debugger.hh>
 #include <thread>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
 
-void show_cpu_info(ANC216::CPUInfo info)
+#define CURSOR_UP(n) "\u001b[" << (n) << "A"
+#define CURSOR_DOWN(n) "\u001b[" << (n) << "B"
+#define CLEAR_LINE "\r\u001b[2K"
+
+static std::vector<std::string> format_cpu_info(const ANC216::CPUInfo &info)
+{
+    std::vector<std::string> lines;
+    std::stringstream line;
+    auto hex = [&line](const char *name, uint16_t value, int width)
+    {
+        line.str("");
+        line << name << " " << std::hex << std::setw(width) << std::setfill('0') << value;
+        return line.str();
+    };
+
+    for (int i = 0; i < 8; i++)
+        lines.push_back(hex(("R" + std::to_string(i)).c_str(), info.reg[i], 4));
+    lines.push_back(hex("PC", info.pc, 4));
+    lines.push_back(hex("SP", info.sp, 4));
+    lines.push_back(hex("BP", info.bp, 4));
+    lines.push_back(hex("SR", info.sr, 2));
+    lines.push_back(hex("IR", info.current_instruction, 4));
+    line.str("");
+    line << "instructions " << std::dec << info.instructions << ", cycles " << info.cycles;
+    lines.push_back(line.str());
+    return lines;
+}
+
+// The first call prints every field, later calls move the cursor back over
+// the previous output and only rewrite the lines that changed
+void show_cpu_info(const ANC216::CPUInfo &info, std::vector<std::string> &shown)
 {
-    #ifdef __WIN32__ 
-        system("cls");
-    #else
-        system("clear");
-    #endif
-    std::cout << "R0 " << std::hex << info.reg[0] << std::endl; 
-    std::cout << "R1 " << std::hex << info.reg[1] << std::endl; 
-    std::cout << "R2 " << std::hex << info.reg[2] << std::endl; 
-    std::cout << "R3 " << std::hex << info.reg[3] << std::endl; 
-    std::cout << "R4 " << std::hex << info.reg[4] << std::endl; 
-    std::cout << "R5 " << std::hex << info.reg[5] << std::endl; 
-    std::cout << "R6 " << std::hex << info.reg[6] << std::endl; 
-    std::cout << "R7 " << std::hex << info.reg[7] << std::endl;
-    std::cout << "PC " << std::hex << info.pc << std::endl;
-    std::cout << "SP " << std::hex << info.sp << std::endl;
-    std::cout << "BP " << std::hex << info.bp << std::endl;
-    std::cout << "SR " << std::hex << info.sr << std::endl;
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    std::vector<std::string> lines = format_cpu_info(info);
+    if (shown.size() != lines.size())
+    {
+        for (auto &line : lines)
+            std::cout << line << "\n";
+        std::cout << std::flush;
+        shown = lines;
+        return;
+    }
+
+    std::cout << CURSOR_UP(lines.size());
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        if (lines[i] != shown[i])
+            std::cout << CLEAR_LINE << lines[i] << "\n";
+        else
+            std::cout << CURSOR_DOWN(1);
+    }
+    std::cout << "\r" << std::flush;
+    shown = lines;
+}
+
+// Addresses are in hexadecimal, with or without 0x, the other numbers in
+// decimal
+static bool parse_number(const std::string &text, uint16_t &value, int base = 16)
+{
+    try
+    {
+        size_t end;
+        unsigned long number = std::stoul(text, &end, base);
+        if (end == text.size() && number <= UINT16_MAX)
+        {
+            value = number;
+            return true;
+        }
+    }
+    catch (const std::exception &)
+    {
+    }
+    PRINT_DBG_ERROR("Invalid number " + text);
+    return false;
+}
+
+static void print_memory(uint16_t address, const std::vector<uint8_t> &data)
+{
+    for (size_t i = 0; i < data.size(); i += 16)
+    {
+        std::cout << std::hex << std::setw(4) << std::setfill('0') << (uint16_t)(address + i) << ":";
+        for (size_t j = i; j < i + 16 && j < data.size(); j++)
+            std::cout << " " << std::setw(2) << (int)data[j];
+        std::cout << "\n";
+    }
+    std::cout << std::flush;
 }
 
 void debug_console(ANC216::CPU &emu, ANC216::EmemMapper &mapper, ANC216::Video::Window &window)
@@ -28,7 +101,7 @@ void debug_console(ANC216::CPU &emu, ANC216::EmemMapper &mapper, ANC216::Video::
     emu.stop();
     std::cout << "The emulator is currently stopped, type 'start' to start.\nType 'help' for more information about the debug console." << std::endl;
     std::string command;
-    bool is_running = false;
+    ANC216::Debugger *debugger = emu.get_debugger();
     while (true)
     {
         std::cout << CYAN << "> " << RESET;
@@ -36,43 +109,163 @@ void debug_console(ANC216::CPU &emu, ANC216::EmemMapper &mapper, ANC216::Video::
         if (command == "help")
             print_debug_help();
         else if (command == "start")
-        {
             emu.start();
-            is_running = true;
-        }
         else if (command == "stop")
-        {
             emu.stop();
-            is_running = false;
-        }
         else if (command == "exit")
+        {
+            emu.stop();
+            emu.flush_trace();
+            try
+            {
+                emu.write_profile();
+            }
+            catch (const std::exception &e)
+            {
+                PRINT_DBG_ERROR(e.what());
+            }
             exit(EXIT_SUCCESS);
+        }
+        else if (command == "stats" || command.starts_with("stats "))
+        {
+            if (!ANC216::Statistics::enabled)
+            {
+                PRINT_DBG_ERROR("The emulator was built without statistics (ANC216_STATS)");
+                continue;
+            }
+            if (command == "stats")
+            {
+                emu.write_statistics(std::cout);
+                continue;
+            }
+            std::ofstream file(command.substr(6));
+            if (!file.is_open())
+                PRINT_DBG_ERROR("Cannot open " + command.substr(6));
+            else
+                emu.write_statistics(file);
+        }
         else if (command == "sh info")
         {
-            if (is_running)
-                do
+            std::vector<std::string> shown;
+            if (emu.is_running())
+            {
+                std::atomic<bool> done = false;
+                std::cout << "Press enter to exit" << std::endl;
+                std::thread input([&done]
+                                  {
+                                      std::string line;
+                                      std::getline(std::cin, line);
+                                      done = true; });
+                while (!done)
                 {
-                    show_cpu_info(emu.get_info());
-                    std::cout << "Press enter to exit" << std::endl;
-                    std::cout << (int)window.key_pressed() << std::endl;
-                    
-                } while (window.key_pressed() != 0x0d);
+                    show_cpu_info(emu.get_info(), shown);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                }
+                input.join();
+            }
             else
+                show_cpu_info(emu.get_info(), shown);
+        }
+        else if (command.starts_with("save state "))
+        {
+            try
+            {
+                ANC216::save_snapshot(command.substr(11), emu.take_snapshot());
+            }
+            catch (const std::exception &e)
+            {
+                PRINT_DBG_ERROR(e.what());
+            }
+        }
+        else if (command.starts_with("load state "))
+        {
+            try
+            {
+                emu.restore_snapshot(ANC216::load_snapshot(command.substr(11)));
+            }
+            catch (const std::exception &e)
             {
-                std::cout << "R0 " << std::hex << emu.get_registers()[0] << std::endl; 
-                std::cout << "R1 " << std::hex << emu.get_registers()[1] << std::endl; 
-                std::cout << "R2 " << std::hex << emu.get_registers()[2] << std::endl; 
-                std::cout << "R3 " << std::hex << emu.get_registers()[3] << std::endl; 
-                std::cout << "R4 " << std::hex << emu.get_registers()[4] << std::endl; 
-                std::cout << "R5 " << std::hex << emu.get_registers()[5] << std::endl; 
-                std::cout << "R6 " << std::hex << emu.get_registers()[6] << std::endl; 
-                std::cout << "R7 " << std::hex << emu.get_registers()[7] << std::endl; 
-
-                std::cout << "PC " << std::hex << emu.get_pc() << std::endl;
+                PRINT_DBG_ERROR(e.what());
             }
         }
         else if (command == "ni")
             emu.step();
+        else if (command == "nj" || command == "nr")
+        {
+            debugger->set_mode(command == "nj" ? ANC216::STOP_AFTER_JUMP : ANC216::STOP_AFTER_RETURN);
+            emu.start();
+        }
+        else if (command.starts_with("b "))
+        {
+            uint16_t address;
+            if (!parse_number(command.substr(2), address))
+                continue;
+            std::cout << "Breakpoint " << std::dec << debugger->add_breakpoint(address) << std::endl;
+        }
+        else if (command == "rm all")
+            debugger->remove_all();
+        else if (command.starts_with("rm "))
+        {
+            uint16_t id;
+            if (!parse_number(command.substr(3), id, 10))
+                continue;
+            if (!debugger->remove(id))
+                PRINT_DBG_ERROR("No breakpoint with this id");
+        }
+        else if (command == "ls b")
+            debugger->list(std::cout);
+        else if (command.starts_with("imem watch "))
+        {
+            std::stringstream args(command.substr(11));
+            std::string address_arg, size_arg;
+            uint16_t address, size;
+            args >> address_arg >> size_arg;
+            if (!parse_number(address_arg, address) || !parse_number(size_arg, size, 10))
+                continue;
+            if (size == 0)
+            {
+                PRINT_DBG_ERROR("The size must be at least 1");
+                continue;
+            }
+            print_memory(address, emu.read_memory(address, size));
+            std::cout << "Watchpoint " << std::dec << debugger->add_watchpoint(address, size) << std::endl;
+        }
+        else if (command.starts_with("stk watch "))
+        {
+            uint16_t size;
+            if (!parse_number(command.substr(10), size, 10))
+                continue;
+            uint16_t sp = emu.get_info().sp;
+            print_memory(sp - size, emu.read_memory(sp - size, size));
+        }
+        else if (command == "rs" || command == "rc" || command.starts_with("goto "))
+        {
+            ANC216::History *history = emu.get_history();
+            if (history == nullptr)
+            {
+                PRINT_DBG_ERROR("The execution history is disabled");
+                continue;
+            }
+            emu.stop();
+            try
+            {
+                if (command == "rs")
+                {
+                    uint64_t current = emu.get_info().instructions;
+                    if (current == 0)
+                        throw std::out_of_range("already at the first instruction");
+                    history->go_to(current - 1);
+                }
+                else if (command == "rc")
+                    history->reverse_continue();
+                else
+                    history->go_to(std::stoull(command.substr(5)));
+            }
+            catch (const std::exception &e)
+            {
+                PRINT_DBG_ERROR(e.what());
+            }
+        }
         else
             PRINT_DBG_ERROR("Unknown command");
     }
@@ -89,13 +282,14 @@ void print_debug_help()
                 << "\t" << CYAN << "b " << YELLOW << "<address>" << RESET << "\t\t\t\tSet a breakpoint\n"
                 << "\t" << CYAN << "rm " << YELLOW << "<breakpoint id>" << RESET << "\t\t\tRemove a breakpoint\n"
                 << "\t" << CYAN << "rm all" << RESET << "\t\t\t\t\tRemove all breakpoints\n"
-                << "\t" << CYAN << "ls b" << RESET << "\t\t\t\t\tLists all breakpoints\n"
+                << "\t" << CYAN << "ls b" << RESET << "\t\t\t\t\tLists all breakpoints and watchpoints\n"
                 
                 << GREEN << "Diagnostics:\n\n" << RESET
 
                 << "\t" << CYAN << "emem watch " << YELLOW << "<address> <size>" << RESET << "\t\tShow the content of the external memory\n"
-                << "\t" << CYAN << "imem watch " << YELLOW << "<address> <size>" << RESET << "\t\tShow the content of the internal memory\n"
+                << "\t" << CYAN << "imem watch " << YELLOW << "<address> <size>" << RESET << "\t\tShow the content of the internal memory and stop when it is written\n"
                 << "\t" << CYAN << "sh info" << RESET << "\t\t\t\t\tShow general information about the CPU\n"
+                << "\t" << CYAN << "stats " << YELLOW << "[file]" << RESET << "\t\t\t\tShow the execution statistics, or write them to a file\n"
                 << "\t" << CYAN << "stk watch " << YELLOW << "<size>" << RESET << "\t\t\tShow the content of the stack memory\n"
                 << "\t" << CYAN << "vmem watch " << YELLOW << "<address> <size>" << RESET << "\t\tShow the content of the video memory\n"
 
@@ -104,6 +298,9 @@ void print_debug_help()
                 << "\t" << CYAN << "ni" << RESET << "\t\t\t\t\tExecute next instrucion\n"
                 << "\t" << CYAN << "nj" << RESET << "\t\t\t\t\tExecute until next jump instruction\n"
                 << "\t" << CYAN << "nr" << RESET << "\t\t\t\t\tExecute until next return instruction\n"
+                << "\t" << CYAN << "rs" << RESET << "\t\t\t\t\tGo back one instruction\n"
+                << "\t" << CYAN << "rc" << RESET << "\t\t\t\t\tGo back to the last breakpoint, or to the start of the history\n"
+                << "\t" << CYAN << "goto " << YELLOW << "<instruction count>" << RESET << "\t\tGo to the state after that many instructions\n"
                 << "\t" << CYAN << "reset" << RESET << "\t\t\t\t\tHard reset\n"
                 << "\t" << CYAN << "stop" << RESET << "\t\t\t\t\tStop the execution\n"
                 << "\t" << CYAN << "start" << RESET << "\t\t\t\t\tStart the execution\n"
@@ -119,6 +316,10 @@ void print_debug_help()
 
                 << GREEN << "Interrupts:\n\n" << RESET
                 << GREEN << "Memory\n\n" << RESET
+
+                << "\t" << CYAN << "save state " << YELLOW << "<file>" << RESET << "\t\t\tSave a snapshot of the machine\n"
+                << "\t" << CYAN << "load state " << YELLOW << "<file>" << RESET << "\t\t\tRestore a snapshot of the machine\n"
+
                 << GREEN << "Other:\n\n" << RESET
 
                 << "\t" << CYAN << "exit" << RESET << "\t\tExit the emulation\n"
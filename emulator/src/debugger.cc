@@ -0,0 +1,160 @@
+#include <debugger.hh>
+#include <iomanip>
+#include <algorithm>
+#include <mutex>
+
+ANC216::Debugger::Debugger(CPU &cpu) : cpu(cpu)
+{
+}
+
+// Rebuilds the breakpoint bitmap and the watched pages of the CPU
+void ANC216::Debugger::update()
+{
+    std::fill(breakpoints, breakpoints + MAX_MEM / 64, 0);
+    std::fill(cpu.watched_pages, cpu.watched_pages + PAGES, false);
+    for (auto &[id, point] : points)
+    {
+        if (point.type == BREAKPOINT)
+        {
+            breakpoints[point.address / 64] |= (uint64_t)1 << (point.address % 64);
+            continue;
+        }
+        uint32_t last = std::min<uint32_t>((uint32_t)point.address + point.size, MAX_MEM) - 1;
+        for (uint32_t page = point.address / PAGE_SIZE; page <= last / PAGE_SIZE; page++)
+            cpu.watched_pages[page] = true;
+    }
+}
+
+// The console changes the points from its own thread. It takes the state
+// lock of the CPU, which the CPU thread holds while it runs and checks them
+unsigned ANC216::Debugger::add_breakpoint(uint16_t address)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    points[next_id] = Point{BREAKPOINT, address, 1};
+    update();
+    return next_id++;
+}
+
+unsigned ANC216::Debugger::add_watchpoint(uint16_t address, uint16_t size)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    points[next_id] = Point{WATCHPOINT, address, size};
+    update();
+    return next_id++;
+}
+
+bool ANC216::Debugger::remove(unsigned id)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    if (points.erase(id) == 0)
+        return false;
+    update();
+    return true;
+}
+
+void ANC216::Debugger::remove_all()
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    points.clear();
+    update();
+}
+
+void ANC216::Debugger::list(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    for (auto &[id, point] : points)
+    {
+        out << std::dec << id << "\t" << (point.type == BREAKPOINT ? "breakpoint" : "watchpoint") << "\t" << std::hex << std::setw(4) << std::setfill('0') << point.address;
+        if (point.type == WATCHPOINT)
+            out << std::dec << "\t" << point.size << " bytes";
+        out << "\n";
+    }
+    out << std::flush;
+}
+
+void ANC216::Debugger::set_mode(StopMode mode)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    this->mode = mode;
+}
+
+uint32_t ANC216::Debugger::take_resume_pc()
+{
+    uint32_t pc = resume_pc;
+    resume_pc = NO_PC;
+    return pc;
+}
+
+void ANC216::Debugger::clear_resume_pc()
+{
+    resume_pc = NO_PC;
+}
+
+// Checked before running the instruction at pc
+bool ANC216::Debugger::should_stop(uint16_t pc, uint32_t skip)
+{
+    if (!is_breakpoint(pc) || pc == skip)
+        return false;
+    for (auto &[id, point] : points)
+        if (point.type == BREAKPOINT && point.address == pc)
+            hit_id = id;
+    hit = true;
+    hit_address = pc;
+    resume_pc = pc;
+    return true;
+}
+
+// Checked after running an instruction, for nj and nr
+bool ANC216::Debugger::should_stop_after(uint8_t opcode)
+{
+    bool stop = (mode == STOP_AFTER_JUMP && (opcode == CALL || (opcode >= JMP && opcode <= JNN))) ||
+                (mode == STOP_AFTER_RETURN && opcode == RET);
+    if (stop)
+        mode = STOP_NONE;
+    return stop || hit;
+}
+
+// Called on writes to a watched page
+void ANC216::Debugger::check_write(uint16_t address)
+{
+    if (hit)
+        return;
+    for (auto &[id, point] : points)
+    {
+        if (point.type == WATCHPOINT && address >= point.address && (uint32_t)address < (uint32_t)point.address + point.size)
+        {
+            hit = true;
+            hit_id = id;
+            hit_address = address;
+            return;
+        }
+    }
+}
+
+bool ANC216::Debugger::stop_requested()
+{
+    return hit;
+}
+
+// Prints why the machine stopped, if it stopped on a breakpoint or watchpoint.
+// Called between slices, without the state lock
+bool ANC216::Debugger::report(std::ostream &out)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    if (!hit)
+        return false;
+    hit = false;
+    auto point = points.find(hit_id);
+    if (point == points.end())
+        return false;
+    if (point->second.type == BREAKPOINT)
+        out << "\nBreakpoint " << std::dec << hit_id << " hit at " << std::hex << std::setw(4) << std::setfill('0') << hit_address << std::endl;
+    else
+        out << "\nWatchpoint " << std::dec << hit_id << ": " << std::hex << std::setw(4) << std::setfill('0') << hit_address << " written, pc " << std::setw(4) << cpu.pc << std::endl;
+    return true;
+}
+
+void ANC216::Debugger::clear_hit()
+{
+    hit = false;
+}
@@ -1,48 +1,199 @@
 #include <emem.hh>
-#include <avc64.hh>
+#include <snapshot.hh>
 #include <iostream>
+#include <algorithm>
+#include <stdexcept>
 
-ANC216::EmemMapper::EmemMapper(const EmuFlags &flags, Video::Window *window)
+ANC216::EmemMapper::EmemMapper(const EmuFlags &flags)
+{
+    this->cpu = nullptr;
+}
+
+
+ANC216::EmemMapper::~EmemMapper()
+{
+    for (auto device : devices)
+        delete device;
+}
+
+void ANC216::EmemMapper::set_cpu(ANC216::CPU *cpu)
 {
     this->cpu = cpu;
-    if (!flags.novideo && flags.gpu == "")
+}
+
+// The mapper takes ownership of the device, which answers on size
+// addresses starting from address
+void ANC216::EmemMapper::map(uint16_t address, ANC216::Device *device, uint16_t size)
+{
+    for (uint32_t i = address; i < (uint32_t)address + size && i < MAX_MEM; i++)
     {
-        std::cerr << RED << "emu::error " << RESET << "video enabled but no GPU specified. Try using --novideo or specifying the gpu with --gpu=" << std::endl;
-        exit(EXIT_FAILURE);
+        auto &page = pages[i / PAGE_SIZE];
+        if (page == nullptr)
+            page = std::make_unique<Page>();
+        page->devices[i % PAGE_SIZE] = device;
     }
-    if (flags.gpu == "default" || flags.gpu == "AVC64")
+    if (bases.emplace(device, address).second)
+        devices.push_back(device);
+}
+
+// A new batch starts whenever the device, the address, the flag or the
+// kind of transfer changes
+void ANC216::EmemMapper::batch_to(Device *device, uint16_t address, bool additional_flag, bool writes, BusRequest type)
+{
+    if (device == batch_device && address == batch_address && additional_flag == batch_flag &&
+        writes == batch_writes && type == batch_type && batch.size() < MAX_BATCH_SIZE)
+        return;
+    flush();
+    batch_device = device;
+    batch_address = address;
+    batch_flag = additional_flag;
+    batch_writes = writes;
+    batch_type = type;
+}
+
+void ANC216::EmemMapper::write(uint16_t value, uint16_t address, bool additional_flag)
+{
+    Device *device = device_at(address);
+    if (device == nullptr)
+        return;
+    if (!device->batches_transfers())
     {
-        emem[DEFAULT_VIDEO_CARD_ADDR].second = new AVC64(this, flags, window);
+        flush();
+        device->cpu_write(value, additional_flag);
+        return;
     }
+    batch_to(device, address, additional_flag, true, READ_REQUEST);
+    batch.push_back(value);
 }
 
+uint16_t ANC216::EmemMapper::read(uint16_t address, bool additional_flag)
+{
+    flush();
+    Device *device = device_at(address);
+    if (device == nullptr)
+        return 0;
+    return device->cpu_read(address - where_am_i(device), additional_flag);
+}
 
-ANC216::EmemMapper::~EmemMapper()
+// Asynchronous read, the data is delivered with an EINR. The EINR is only
+// taken once the current run is over, so a device that batches transfers
+// can answer consecutive requests together when the batch is flushed
+void ANC216::EmemMapper::request(uint16_t address, bool additional_flag, bool high)
 {
-    delete this->emem;
+    Device *device = device_at(address);
+    BusRequest type = high ? HIGH_READ_REQUEST : READ_REQUEST;
+    if (device == nullptr || !device->batches_transfers())
+    {
+        flush();
+        if (device != nullptr)
+            respond(address, device->cpu_read(address - where_am_i(device), additional_flag), type);
+        return;
+    }
+    batch_to(device, address, additional_flag, false, type);
+    batch.push_back(0);
 }
 
-void ANC216::EmemMapper::set_cpu(ANC216::CPU *cpu)
+void ANC216::EmemMapper::info_req(uint16_t address)
 {
-    this->cpu = cpu;
+    flush();
+    Device *device = device_at(address);
+    if (device == nullptr)
+        return;
+    respond(address, device->cpu_info_req(), INFO_REQUEST);
+}
+
+void ANC216::EmemMapper::flush()
+{
+    if (batch.empty())
+        return;
+    if (batch_writes)
+        batch_device->cpu_write_block(batch.data(), batch.size(), batch_flag);
+    else
+    {
+        batch_device->cpu_read_block(batch_address - where_am_i(batch_device), batch.data(), batch.size(), batch_flag);
+        {
+            std::lock_guard<std::mutex> lock(responses_mutex);
+            for (uint16_t data : batch)
+                responses.push_back({batch_address, data, batch_type});
+        }
+        if (cpu != nullptr)
+            cpu->einr();
+    }
+    batch.clear();
 }
 
-uint16_t ANC216::EmemMapper::where_am_i(const ANC216::Device *device)
+// Can be called by devices from any thread
+void ANC216::EmemMapper::respond(uint16_t address, uint16_t data, BusRequest type)
 {
-    for (uint16_t i = 0; i < MAX_MEM; i++)
-        if (emem[i].second == device)
-            return i;
-    return 0;
+    {
+        std::lock_guard<std::mutex> lock(responses_mutex);
+        responses.push_back({address, data, type});
+    }
+    if (cpu != nullptr)
+        cpu->einr();
 }
 
-void ANC216::EmemMapper::write(uint16_t value, uint16_t address)
+bool ANC216::EmemMapper::next_response(BusResponse &response)
 {
+    std::lock_guard<std::mutex> lock(responses_mutex);
+    if (responses.empty())
+        return false;
+    response = responses.front();
+    responses.pop_front();
+    return true;
 }
 
-void ANC216::EmemMapper::read(uint16_t value, uint16_t address)
+// Writes still batched are handed to their device first, so they are part
+// of its state
+void ANC216::EmemMapper::save_state(Snapshot &snapshot)
 {
+    flush();
+    snapshot.devices.clear();
+    for (auto device : devices)
+    {
+        std::vector<uint8_t> state;
+        device->save_state(state);
+        snapshot.devices.push_back(std::move(state));
+    }
+    std::lock_guard<std::mutex> lock(responses_mutex);
+    snapshot.responses = responses;
 }
 
-void ANC216::EmemMapper::info_req(uint16_t address)
+// The snapshot must come from a machine with the same devices mapped
+void ANC216::EmemMapper::load_state(const Snapshot &snapshot)
+{
+    if (snapshot.devices.size() != devices.size())
+        throw std::runtime_error("the snapshot was taken with different devices");
+    batch.clear();
+    batch_device = nullptr;
+    for (size_t i = 0; i < devices.size(); i++)
+        devices[i]->load_state(snapshot.devices[i]);
+    std::lock_guard<std::mutex> lock(responses_mutex);
+    responses = snapshot.responses;
+}
+
+// Devices schedule their events on the cycles of the CPU, from the CPU
+// thread only
+uint64_t ANC216::EmemMapper::get_cycles()
+{
+    return cpu != nullptr ? cpu->get_cycles() : 0;
+}
+
+ANC216::EventId ANC216::EmemMapper::schedule(uint64_t when, EventAction action)
+{
+    return cpu != nullptr ? cpu->schedule_event(when, std::move(action)) : 0;
+}
+
+void ANC216::EmemMapper::cancel(EventId id)
+{
+    if (cpu != nullptr)
+        cpu->cancel_event(id);
+}
+
+// The CPU drops every event when it goes back to a snapshot or through the
+// history, then asks the devices for theirs again
+void ANC216::EmemMapper::schedule_events()
 {
+    for (auto device : devices)
+        device->schedule_events();
 }
@@ -0,0 +1,94 @@
+#include <hash.hh>
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t value, int bits)
+{
+    return value << bits | value >> (64 - bits);
+}
+
+// xxHash is defined on little endian words
+static inline uint64_t read64(const uint8_t *p)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--)
+        value = value << 8 | p[i];
+    return value;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+static inline uint64_t merge(uint64_t acc, uint64_t value)
+{
+    acc ^= round(0, value);
+    return acc * PRIME1 + PRIME4;
+}
+
+uint64_t ANC216::xxh64(const void *data, size_t size, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    const uint8_t *end = p + size;
+    uint64_t hash;
+
+    if (size >= 32)
+    {
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+        // Four independent lanes, the loop the compiler pipelines
+        do
+        {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+            p += 32;
+        } while (end - p >= 32);
+        hash = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        hash = merge(hash, v1);
+        hash = merge(hash, v2);
+        hash = merge(hash, v3);
+        hash = merge(hash, v4);
+    }
+    else
+        hash = seed + PRIME5;
+
+    hash += size;
+    for (; end - p >= 8; p += 8)
+    {
+        hash ^= round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+    }
+    if (end - p >= 4)
+    {
+        hash ^= read32(p) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++)
+    {
+        hash ^= *p * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,185 @@
+#include <history.hh>
+#include <stdexcept>
+#include <algorithm>
+#include <debugger.hh>
+
+ANC216::History::History(CPU &cpu, size_t size, uint64_t interval) : cpu(cpu), size(size), interval(interval), detached(cpu.flags)
+{
+}
+
+// Called by the CPU before running, with the state lock held
+void ANC216::History::record()
+{
+    if (rewound)
+        truncate();
+    if (checkpoints.empty() || cpu.instructions >= checkpoints.back().state.instructions + interval)
+        checkpoint();
+}
+
+// Pages not written since the previous checkpoint are shared with it, so
+// the memory used grows with the pages written, up to size full copies
+void ANC216::History::checkpoint()
+{
+    checkpoints.push_back(Checkpoint{cpu.capture(), first_event + events.size()});
+    if (checkpoints.size() <= size)
+        return;
+    checkpoints.pop_front();
+    uint64_t first = checkpoints.front().event;
+    events.erase(events.begin(), events.begin() + (first - first_event));
+    first_event = first;
+}
+
+// The machine runs again from an earlier point, what was recorded after
+// it can't happen anymore
+void ANC216::History::truncate()
+{
+    events.erase(events.begin() + (cursor - first_event), events.end());
+    while (!checkpoints.empty() && checkpoints.back().state.instructions > cpu.instructions)
+        checkpoints.pop_back();
+    rewound = false;
+}
+
+void ANC216::History::log_interrupt(uint8_t source, const BusResponse &response)
+{
+    events.push_back(Event{cpu.instructions, INTERRUPT_EVENT, source, response});
+}
+
+uint16_t ANC216::History::read(uint16_t address, bool additional_flag)
+{
+    if (replaying)
+    {
+        if (cursor == first_event + events.size() || events[cursor - first_event].type != READ_EVENT)
+            return 0;
+        return events[cursor++ - first_event].response.data;
+    }
+
+    uint16_t data = cpu.emem->read(address, additional_flag);
+    events.push_back(Event{cpu.instructions, READ_EVENT, 0, {address, data, READ_REQUEST}});
+    return data;
+}
+
+// Restores the checkpoint and runs one instruction at a time up to the
+// target, calling visit before each one. The logged reads and interrupts
+// are fed back at the instruction they happened at, the bus is detached and
+// the output thrown away, so devices only see the execution once. The bus
+// is detached before restoring, so the devices schedule no events and only
+// the timer runs during the replay
+void ANC216::History::replay(const Checkpoint &checkpoint, uint64_t target, const std::function<void()> &visit)
+{
+    EmemMapper *bus = cpu.emem;
+    std::ostream *out = cpu.out;
+    std::ostream *err = cpu.err;
+    cpu.emem = &detached;
+    cpu.out = &discard;
+    cpu.err = &discard;
+    replaying = true;
+
+    cpu.restore(checkpoint.state);
+    cursor = checkpoint.event;
+
+    while (true)
+    {
+        while (cursor < first_event + events.size() && events[cursor - first_event].instruction == cpu.instructions &&
+               events[cursor - first_event].type == INTERRUPT_EVENT)
+        {
+            const Event &event = events[cursor++ - first_event];
+            cpu.take_interrupt(event.source, event.response);
+        }
+        if (cpu.instructions >= target)
+            break;
+        if (visit)
+            visit();
+        cpu.replay_instruction();
+    }
+
+    replaying = false;
+    cpu.emem = bus;
+    cpu.out = out;
+    cpu.err = err;
+    // The devices go on from the cycle the replay stopped at
+    cpu.scheduler.clear();
+    cpu.timer.load_state(cpu.timer.save_state());
+    cpu.emem->schedule_events();
+    if (cpu.debugger != nullptr)
+        cpu.debugger->clear_hit();
+}
+
+// The last checkpoint taken at or before the instruction
+std::deque<ANC216::History::Checkpoint>::iterator ANC216::History::checkpoint_before(uint64_t instruction)
+{
+    return std::prev(std::upper_bound(checkpoints.begin(), checkpoints.end(), instruction, [](uint64_t instruction, const Checkpoint &checkpoint)
+                                      { return instruction < checkpoint.state.instructions; }));
+}
+
+void ANC216::History::begin_rewind()
+{
+    if (rewound)
+        return;
+    newest = cpu.instructions;
+    rewound = true;
+}
+
+void ANC216::History::go_to(uint64_t target)
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    if (checkpoints.empty() || target < oldest() || target > latest())
+        throw std::out_of_range("instruction " + std::to_string(target) + " is not in the history");
+    begin_rewind();
+    replay(*checkpoint_before(target), target, nullptr);
+    cpu.publish();
+}
+
+// Goes back to the last time the machine was about to run an instruction
+// with a breakpoint on it. Each interval is replayed once to look for it,
+// from the newest to the oldest, then once more to get there
+void ANC216::History::reverse_continue()
+{
+    std::lock_guard<std::mutex> lock(cpu.state_mutex);
+    if (checkpoints.empty())
+        return;
+    begin_rewind();
+
+    uint64_t current = cpu.instructions;
+    uint64_t end = current;
+    auto checkpoint = checkpoint_before(current == 0 ? 0 : current - 1);
+    while (cpu.debugger != nullptr)
+    {
+        uint64_t found = UINT64_MAX;
+        replay(*checkpoint, end, [this, current, &found]
+               {
+                   if (cpu.instructions < current && cpu.debugger->is_breakpoint(cpu.pc))
+                       found = cpu.instructions; });
+        if (found != UINT64_MAX)
+        {
+            replay(*checkpoint_before(found), found, nullptr);
+            cpu.publish();
+            return;
+        }
+        if (checkpoint == checkpoints.begin())
+            break;
+        end = checkpoint->state.instructions;
+        checkpoint--;
+    }
+
+    replay(checkpoints.front(), oldest(), nullptr);
+    cpu.publish();
+}
+
+uint64_t ANC216::History::oldest()
+{
+    return checkpoints.empty() ? 0 : checkpoints.front().state.instructions;
+}
+
+uint64_t ANC216::History::latest()
+{
+    return rewound ? newest : cpu.instructions;
+}
+
+void ANC216::History::clear()
+{
+    checkpoints.clear();
+    events.clear();
+    first_event = 0;
+    cursor = 0;
+    rewound = false;
+}
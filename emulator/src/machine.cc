@@ -0,0 +1,120 @@
+#include <machine.hh>
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+// Machines always run like --headless
+static ANC216::EmuFlags machine_flags(ANC216::EmuFlags flags)
+{
+    flags.debug_mode = false;
+    flags.headless = true;
+    flags.fast_mode = true;
+    flags.novideo = true;
+    flags.noaudio = true;
+    flags.nokeyboard = true;
+    flags.max_speed = true;
+    flags.timeout = 0;
+    return flags;
+}
+
+// Images that fit in the ROM are loaded at ROM_ADDR, bigger ones are
+// memory images loaded from address 0. UALf headers are skipped
+void ANC216::load_boot_image(CPU &cpu, std::vector<uint8_t> image)
+{
+    if (image.size() >= 11 && image[0] == 'U' && image[1] == 'A' && image[2] == 'L')
+    {
+        size_t header_size = image[9] << 8 | image[10];
+        image.erase(image.begin(), image.begin() + std::min(header_size, image.size()));
+    }
+
+    if (image.size() > MAX_MEM)
+        throw std::runtime_error("the boot image is bigger than the memory");
+    cpu.load_memory(image.size() <= MAX_MEM - ROM_ADDR ? ROM_ADDR : 0, image);
+}
+
+ANC216::Machine::Machine(const EmuFlags &flags)
+    : flags(machine_flags(flags)), mapper(this->flags), cpu(&mapper, this->flags)
+{
+    mapper.set_cpu(&cpu);
+    cpu.set_output(&out, &err);
+}
+
+void ANC216::Machine::load_memory(uint16_t address, const std::vector<uint8_t> &data)
+{
+    cpu.load_memory(address, data);
+}
+
+std::vector<uint8_t> ANC216::Machine::read_memory(uint16_t address, uint16_t size)
+{
+    return cpu.read_memory(address, size);
+}
+
+void ANC216::Machine::load_boot_image(const std::vector<uint8_t> &image)
+{
+    ANC216::load_boot_image(cpu, image);
+}
+
+void ANC216::Machine::load_boot_file(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open the boot image " + filename);
+    load_boot_image(std::vector<uint8_t>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>()));
+}
+
+// The mapper takes ownership of the device
+void ANC216::Machine::map(uint16_t address, Device *device, uint16_t size)
+{
+    mapper.map(address, device, size);
+}
+
+// Runs at most cycles emulated cycles, returns false once the guest exited
+// or the instruction budget ran out
+bool ANC216::Machine::run(uint64_t cycles)
+{
+    cpu.run_for(cycles);
+    return !cpu.is_killed();
+}
+
+bool ANC216::Machine::finished()
+{
+    return cpu.is_killed();
+}
+
+ANC216::CPUInfo ANC216::Machine::get_state()
+{
+    return cpu.get_info();
+}
+
+void ANC216::Machine::set_state(const CPUInfo &info)
+{
+    cpu.set_state(info);
+}
+
+ANC216::MachineResult ANC216::Machine::result()
+{
+    MachineResult result;
+    result.exit_code = cpu.get_registers()[0];
+    result.out_of_budget = cpu.budget_exceeded();
+    result.instructions = cpu.get_instructions();
+    result.cycles = cpu.get_cycles();
+    result.output = out.str();
+    result.errors = err.str();
+    return result;
+}
+
+ANC216::CPU &ANC216::Machine::get_cpu()
+{
+    return cpu;
+}
+
+// For the devices of the machine, which answer the CPU through it
+ANC216::EmemMapper *ANC216::Machine::get_mapper()
+{
+    return &mapper;
+}
+
+const ANC216::EmuFlags &ANC216::Machine::get_flags()
+{
+    return flags;
+}
@@ -1,4 +1,6 @@
 #include <iostream>
+#include <cstring>
+#include <fstream>
 #include <filesystem>
 #include <common.hh>
 #include <console.hh>
@@ -6,6 +8,12 @@
 #include <video.hh>
 #include <cpu.hh>
 #include <debug.hh>
+#include <avc64.hh>
+#include <offscreen.hh>
+#include <audio.hh>
+#include <audiocard.hh>
+#include <snapshot.hh>
+#include <runner.hh>
 
 namespace fs = std::filesystem;
 
@@ -27,6 +35,14 @@ enum Flag
     NOVIDEO,
     NOKEYBOARD,
     SPEED,
+    SLICE,
+    ENGINE,
+    HEADLESS,
+    MAX_INSTRUCTIONS,
+    TIMEOUT,
+    STATE,
+    HISTORY,
+    CHECKPOINT_INTERVAL,
     HELP,
     GPU,
     BOOT,
@@ -37,6 +53,13 @@ enum Flag
 void print_help(char **);
 void print_help_for_flag(const std::string &);
 ANC216::EmuFlags get_flags(int argc, char ** argv);
+void load_boot_image(ANC216::CPU &, const std::string &);
+void load_state(ANC216::CPU &, const std::string &);
+void start_trace(ANC216::CPU &, const std::string &);
+void start_profile(ANC216::CPU &, const ANC216::EmuFlags &);
+void write_statistics(ANC216::CPU &, const std::string &);
+int run_batch(const ANC216::EmuFlags &);
+ANC216::Video::FrameFormat frame_format(const std::string &);
 
 int main(int argc, char **argv)
 {
@@ -60,13 +83,55 @@ int main(int argc, char **argv)
         }
     }
 
-    
-    ANC216::Video::Window window;
     ANC216::EmuFlags emu_flags = get_flags(argc, argv);
-    ANC216::EmemMapper mapper(emu_flags, &window);
+    if (emu_flags.batchfile != "")
+        exit(run_batch(emu_flags));
+    ANC216::EmemMapper mapper(emu_flags);
     ANC216::CPU cpu(&mapper, emu_flags);
     mapper.set_cpu(&cpu);
-    
+    if (emu_flags.bootfile != "")
+        load_boot_image(cpu, emu_flags.bootfile);
+
+    // The frame dumps and hashes take the place of the window, also when
+    // running headless
+    bool offscreen_video = emu_flags.framefile != "" || emu_flags.hashfile != "";
+    ANC216::Video::Offscreen offscreen(emu_flags.framefile, frame_format(emu_flags.frame_format), emu_flags.frame_interval, emu_flags.hashfile);
+    if (offscreen_video)
+        mapper.map(DEFAULT_VIDEO_CARD_ADDR, new ANC216::AVC64(&mapper, emu_flags, &offscreen));
+
+    // Without sound the card is still there, its samples are dropped
+    ANC216::Audio::NullSink null_sink;
+    ANC216::Audio::Speaker speaker;
+    ANC216::Audio::Sink *sink = emu_flags.noaudio || emu_flags.fast_mode ? (ANC216::Audio::Sink *)&null_sink : &speaker;
+    mapper.map(DEFAULT_AUDIO_CARD_ADDR, new ANC216::AudioCard(&mapper, emu_flags, sink));
+
+    if (emu_flags.headless)
+    {
+        if (emu_flags.statefile != "")
+            load_state(cpu, emu_flags.statefile);
+        if (emu_flags.tracefile != "")
+            start_trace(cpu, emu_flags.tracefile);
+        if (emu_flags.profilefile != "")
+            start_profile(cpu, emu_flags);
+        cpu.run();
+        if (cpu.budget_exceeded())
+            std::cerr << YELLOW << "emu::warning" << RESET << " execution budget exhausted after " << std::dec << cpu.get_instructions() << " instructions" << std::endl;
+        if (emu_flags.statsfile != "")
+            write_statistics(cpu, emu_flags.statsfile);
+        exit((uint16_t)cpu.get_registers()[0]);
+    }
+
+    ANC216::Video::Window window;
+    if (!emu_flags.novideo && !offscreen_video)
+        mapper.map(DEFAULT_VIDEO_CARD_ADDR, new ANC216::AVC64(&mapper, emu_flags, &window));
+    if (emu_flags.statefile != "")
+        load_state(cpu, emu_flags.statefile);
+    if (emu_flags.tracefile != "")
+        start_trace(cpu, emu_flags.tracefile);
+    if (emu_flags.profilefile != "")
+        start_profile(cpu, emu_flags);
+    cpu.launch();
+
     if (emu_flags.debug_mode)
     {
         std::thread dbg_console_thread(debug_console, std::ref(cpu), std::ref(mapper), std::ref(window));
@@ -75,6 +140,8 @@ int main(int argc, char **argv)
 
     window.wait();
     cpu.wait();
+    if (emu_flags.statsfile != "")
+        write_statistics(cpu, emu_flags.statsfile);
     exit(EXIT_SUCCESS);
     return 0;
 }
@@ -91,18 +158,180 @@ ANC216::EmuFlags get_flags(int argc, char ** argv)
     {
         if (args[i] == "-b" || args[i] == "--boot")
         {
+            i++;
             CHECK_NEXT_ARG(i, args);
             flags.bootfile = args[i];
         }
         else if (args[i].starts_with("--gpu="))
         {
-            auto gpu = args[i].substr(5);
+            auto gpu = args[i].substr(6);
             if (gpu != "default")
             {
                 PRINT_CLI_ERROR("Only default GPU is supported");
                 exit(EXIT_FAILURE);
             }
-            flags.gpu = args[i].substr(5);
+            flags.gpu = gpu;
+        }
+        else if (args[i] == "-f" || args[i] == "--fast-mode")
+        {
+            flags.fast_mode = true;
+        }
+        else if (args[i].starts_with("--batch="))
+        {
+            flags.batchfile = args[i].substr(8);
+            if (flags.batchfile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid batch file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--threads="))
+        {
+            auto threads = args[i].substr(10);
+            if (threads.empty() || threads.find_first_not_of("0123456789") != std::string::npos)
+            {
+                PRINT_CLI_ERROR("Invalid number of threads");
+                exit(EXIT_FAILURE);
+            }
+            flags.threads = std::stoul(threads);
+        }
+        else if (args[i] == "--headless")
+        {
+            flags.headless = true;
+        }
+        else if (args[i].starts_with("--frames="))
+        {
+            flags.framefile = args[i].substr(9);
+            if (flags.framefile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid frame path");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--frame-format="))
+        {
+            flags.frame_format = args[i].substr(15);
+            if (flags.frame_format != "ppm" && flags.frame_format != "png" && flags.frame_format != "raw")
+            {
+                PRINT_CLI_ERROR("Invalid frame format");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--frame-interval="))
+        {
+            auto interval = args[i].substr(17);
+            if (interval.empty() || interval.find_first_not_of("0123456789") != std::string::npos)
+            {
+                PRINT_CLI_ERROR("Invalid frame interval");
+                exit(EXIT_FAILURE);
+            }
+            flags.frame_interval = std::stoull(interval);
+        }
+        else if (args[i].starts_with("--frame-hashes="))
+        {
+            flags.hashfile = args[i].substr(15);
+            if (flags.hashfile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid frame hash file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--max-instructions="))
+        {
+            auto max = args[i].substr(19);
+            if (max.empty() || max.find_first_not_of("0123456789") != std::string::npos)
+            {
+                PRINT_CLI_ERROR("Invalid instruction budget");
+                exit(EXIT_FAILURE);
+            }
+            flags.max_instructions = std::stoull(max);
+        }
+        else if (args[i].starts_with("--history="))
+        {
+            auto size = args[i].substr(10);
+            if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos)
+            {
+                PRINT_CLI_ERROR("Invalid history size");
+                exit(EXIT_FAILURE);
+            }
+            flags.history_size = std::stoul(size);
+        }
+        else if (args[i].starts_with("--checkpoint-interval="))
+        {
+            auto interval = args[i].substr(22);
+            if (interval.empty() || interval.find_first_not_of("0123456789") != std::string::npos || std::stoull(interval) == 0)
+            {
+                PRINT_CLI_ERROR("Invalid checkpoint interval");
+                exit(EXIT_FAILURE);
+            }
+            flags.checkpoint_interval = std::stoull(interval);
+        }
+        else if (args[i].starts_with("--state="))
+        {
+            flags.statefile = args[i].substr(8);
+            if (flags.statefile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid snapshot file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--profile="))
+        {
+            flags.profilefile = args[i].substr(10);
+            if (flags.profilefile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid profile file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--profile-interval="))
+        {
+            auto interval = args[i].substr(19);
+            if (interval.empty() || interval.find_first_not_of("0123456789") != std::string::npos || std::stoull(interval) == 0)
+            {
+                PRINT_CLI_ERROR("Invalid profile interval");
+                exit(EXIT_FAILURE);
+            }
+            flags.profile_interval = std::stoull(interval);
+        }
+        else if (args[i].starts_with("--stats="))
+        {
+            flags.statsfile = args[i].substr(8);
+            if (flags.statsfile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid statistics file");
+                exit(EXIT_FAILURE);
+            }
+            if (!ANC216::Statistics::enabled)
+                std::cerr << YELLOW << "emu::warning" << RESET << " the emulator was built without statistics (ANC216_STATS), the file will be empty" << std::endl;
+        }
+        else if (args[i].starts_with("--symbols="))
+        {
+            flags.symbolfile = args[i].substr(10);
+            if (flags.symbolfile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid symbol file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--trace="))
+        {
+            flags.tracefile = args[i].substr(8);
+            if (flags.tracefile.empty())
+            {
+                PRINT_CLI_ERROR("Invalid trace file");
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (args[i].starts_with("--timeout="))
+        {
+            auto timeout = args[i].substr(10);
+            if (timeout.empty() || timeout.find_first_not_of("0123456789") != std::string::npos)
+            {
+                PRINT_CLI_ERROR("Invalid timeout");
+                exit(EXIT_FAILURE);
+            }
+            flags.timeout = std::stoul(timeout);
         }
         else if (args[i] == "-d" || args[i] == "--debug")
         {
@@ -123,22 +352,206 @@ ANC216::EmuFlags get_flags(int argc, char ** argv)
         }
         else if (args[i] == "--noaudio")
         {
-            flags.noaudio;
+            flags.noaudio = true;
         }
         else if (args[i].starts_with("--speed="))
         {
-            auto speed = args[i].substr(7);
-            if (speed != "0.1" || speed != "0.5" || speed != "1" || speed != "2" || speed != "5")
+            auto speed = args[i].substr(8);
+            if (speed == "max")
+            {
+                flags.max_speed = true;
+                continue;
+            }
+            if (speed != "0.1" && speed != "0.5" && speed != "1" && speed != "2" && speed != "5")
             {
                 PRINT_CLI_ERROR("Invalid speed");
                 exit(EXIT_FAILURE);
             }
             flags.speed = std::stof(speed);
         }
+        else if (args[i].starts_with("--engine="))
+        {
+            auto engine = args[i].substr(9);
+            if (engine != "interpreter" && engine != "blocks")
+            {
+                PRINT_CLI_ERROR("Invalid engine");
+                exit(EXIT_FAILURE);
+            }
+            flags.block_engine = engine == "blocks";
+        }
+        else if (args[i].starts_with("--slice="))
+        {
+            auto slice = args[i].substr(8);
+            if (slice.empty() || slice.find_first_not_of("0123456789") != std::string::npos || std::stoul(slice) == 0)
+            {
+                PRINT_CLI_ERROR("Invalid slice size");
+                exit(EXIT_FAILURE);
+            }
+            flags.slice_cycles = std::stoul(slice);
+        }
+    }
+
+    if (flags.batchfile != "" && flags.debug_mode)
+    {
+        PRINT_CLI_ERROR("--batch cannot be used with --debug");
+        exit(EXIT_FAILURE);
+    }
+
+    // The picture goes to the files instead of the window
+    if (flags.framefile != "" || flags.hashfile != "")
+        flags.novideo = true;
+
+    if (flags.headless)
+    {
+        if (flags.debug_mode)
+        {
+            PRINT_CLI_ERROR("--headless cannot be used with --debug");
+            exit(EXIT_FAILURE);
+        }
+        if (flags.bootfile == "" && flags.statefile == "")
+        {
+            PRINT_CLI_ERROR("--headless requires a boot image or a snapshot");
+            exit(EXIT_FAILURE);
+        }
+        flags.fast_mode = true;
+        flags.novideo = true;
+        flags.noaudio = true;
+        flags.nokeyboard = true;
+        flags.max_speed = true;
     }
     return flags;
 }
 
+void load_boot_image(ANC216::CPU &cpu, const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+    {
+        std::cerr << RED << "emu::error " << RESET << "cannot open the boot image " << filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::vector<uint8_t> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    try
+    {
+        ANC216::load_boot_image(cpu, image);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << filename << ": " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void load_state(ANC216::CPU &cpu, const std::string &filename)
+{
+    try
+    {
+        cpu.restore_snapshot(ANC216::load_snapshot(filename));
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void start_trace(ANC216::CPU &cpu, const std::string &filename)
+{
+    try
+    {
+        cpu.start_trace(filename);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void start_profile(ANC216::CPU &cpu, const ANC216::EmuFlags &flags)
+{
+    try
+    {
+        cpu.start_profile(flags.profilefile, flags.profile_interval, flags.symbolfile);
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void write_statistics(ANC216::CPU &cpu, const std::string &filename)
+{
+    std::ofstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << RED << "emu::error " << RESET << "cannot open " << filename << std::endl;
+        return;
+    }
+    cpu.write_statistics(file);
+}
+
+// Every line of the batch file is a boot image. They all run headless on
+// a pool of threads and a line is printed for each with its exit code and
+// the instructions it ran. Exits with failure if any image can't be run
+int run_batch(const ANC216::EmuFlags &flags)
+{
+    std::ifstream file(flags.batchfile);
+    if (!file.is_open())
+    {
+        std::cerr << RED << "emu::error " << RESET << "cannot open " << flags.batchfile << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    ANC216::Runner runner(flags.threads, flags.slice_cycles);
+    std::vector<std::string> images;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty())
+            continue;
+        std::ifstream image_file(line, std::ios::binary);
+        if (!image_file.is_open())
+        {
+            std::cerr << RED << "emu::error " << RESET << "cannot open the boot image " << line << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> image((std::istreambuf_iterator<char>(image_file)), std::istreambuf_iterator<char>());
+        runner.add(flags, image);
+        images.push_back(line);
+    }
+
+    std::vector<ANC216::MachineResult> results;
+    try
+    {
+        results = runner.run();
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << RED << "emu::error " << RESET << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        std::cout << images[i] << "\t" << std::dec << results[i].exit_code << "\t" << results[i].instructions;
+        if (results[i].out_of_budget)
+            std::cout << "\tbudget exhausted";
+        std::cout << "\n";
+    }
+    return EXIT_SUCCESS;
+}
+
+ANC216::Video::FrameFormat frame_format(const std::string &format)
+{
+    if (format == "png")
+        return ANC216::Video::FRAME_PNG;
+    if (format == "raw")
+        return ANC216::Video::FRAME_RAW;
+    return ANC216::Video::FRAME_PPM;
+}
+
 void print_help(char **argv)
 {
     std::cout << "Usage:\n"
@@ -146,6 +559,9 @@ void print_help(char **argv)
               << RESET
               << "\nOptions:\n"
 
+              << CYAN << "--batch=<file>" << RESET << "\t\t\t\t"
+              << "run every boot image listed in the file headless on a pool of threads"
+              << "\n"
               << CYAN << "-b <file>" << RESET << "\t\t\t\t"
               << "select the binary file used for bootloader or OS"
               << "\n"
@@ -158,9 +574,21 @@ void print_help(char **argv)
               << CYAN << "--debug" << RESET << "\t\t\t\t\t"
               << "same as -d"
               << "\n"
+              << CYAN << "--checkpoint-interval=<n>" << RESET << "\t\t"
+              << "take a history checkpoint every n instructions in debug mode"
+              << "\n"
               << CYAN << "--default-charmap" << RESET << "\t\t\t"
               << "use the default charmap"
               << "\n"
+              << CYAN << "--engine=<val>" << RESET << "\t\t\t\t"
+              << "select how the CPU executes the code"
+              << "\n"
+              << YELLOW << "        =interpreter" << RESET << "\t\t\t"
+              << "decode and run one instruction at a time (default)"
+              << "\n"
+              << YELLOW << "        =blocks" << RESET << "\t\t\t\t"
+              << "translate and run whole basic blocks"
+              << "\n"
               << CYAN << "--ext <address> <file>" << RESET << "\t\t\t"
               << "load the emulator with the specified extension"
               << "\n"
@@ -170,6 +598,27 @@ void print_help(char **argv)
               << CYAN << "--fast-mode <file>" << RESET << "\t\t\t"
               << "same as -f"
               << "\n"
+              << CYAN << "--frames=<path>" << RESET << "\t\t\t\t"
+              << "dump the frames of the video card to files starting with path instead of a window"
+              << "\n"
+              << CYAN << "--frame-format=<val>" << RESET << "\t\t\t"
+              << "select the format of the frame dumps"
+              << "\n"
+              << YELLOW << "              =ppm" << RESET << "\t\t\t"
+              << "one binary PPM file per frame (default)"
+              << "\n"
+              << YELLOW << "              =png" << RESET << "\t\t\t"
+              << "one PNG file per frame"
+              << "\n"
+              << YELLOW << "              =raw" << RESET << "\t\t\t"
+              << "all the frames in the file as RGB24"
+              << "\n"
+              << CYAN << "--frame-hashes=<file>" << RESET << "\t\t\t"
+              << "write the hash of every frame to the file"
+              << "\n"
+              << CYAN << "--frame-interval=<n>" << RESET << "\t\t\t"
+              << "dump one frame every n, 0 only dumps the frames the guest captures"
+              << "\n"
               << CYAN << "--gpu=<val>" << RESET << "\t\t\t\t"
               << "specify the emulated GPU to use"
               << "\n"
@@ -179,9 +628,15 @@ void print_help(char **argv)
               << YELLOW << "     =<file>" << RESET << "\t\t\t\t"
               << "use the specified GPU capable extension"
               << "\n"
+              << CYAN << "--headless" << RESET << "\t\t\t\t"
+              << "run the boot image without video, audio and keyboard and exit with R0 as exit code"
+              << "\n"
               << CYAN << "--help [flag]" << RESET << "\t\t\t\t"
               << "show this help"
               << "\n"
+              << CYAN << "--history=<n>" << RESET << "\t\t\t\t"
+              << "keep at most n history checkpoints in debug mode, 0 disables the history"
+              << "\n"
               << CYAN << "-i <address> <file>" << RESET << "\t\t\t"
               << "specify a raw binary file that will be loaded in the emem using a virtual ROM"
               << "\n"
@@ -194,8 +649,11 @@ void print_help(char **argv)
               << CYAN << "--insert-charmap <file>" << RESET << "\t\t\t"
               << "load the charmap into the GPU"
               << "\n"
+              << CYAN << "--max-instructions=<n>" << RESET << "\t\t\t"
+              << "stop the machine after n instructions"
+              << "\n"
               << CYAN << "--noaudio" << RESET << "\t\t\t\t"
-              << "disable audio"
+              << "drop the sound of the audio card"
               << "\n"
               << CYAN << "--nokeyboard" << RESET << "\t\t\t\t"
               << "disable keyboard interrupts"
@@ -203,6 +661,15 @@ void print_help(char **argv)
               << CYAN << "--novideo" << RESET << "\t\t\t\t"
               << "disable video"
               << "\n"
+              << CYAN << "--profile=<file>" << RESET << "\t\t\t"
+              << "write a profile of the guest code as collapsed stacks"
+              << "\n"
+              << CYAN << "--profile-interval=<cycles>" << RESET << "\t\t"
+              << "take a profile sample every n cycles (default 1000)"
+              << "\n"
+              << CYAN << "--slice=<cycles>" << RESET << "\t\t\t"
+              << "specify how many cycles are emulated between two pauses"
+              << "\n"
               << CYAN << "--speed=<val>" << RESET << "\t\t\t\t"
               << "specify the emulation speed"
               << "\n"
@@ -214,7 +681,28 @@ void print_help(char **argv)
               << "\n"
               << YELLOW << "       =2"
               << "\n"
-              << YELLOW << "       =5" << RESET << "\n\n\n"
+              << YELLOW << "       =5"
+              << "\n"
+              << YELLOW << "       =max"
+              << "\n"
+              << CYAN << "--state=<file>" << RESET << "\t\t\t\t"
+              << "start the machine from a snapshot saved from the debug console"
+              << "\n"
+              << CYAN << "--stats=<file>" << RESET << "\t\t\t\t"
+              << "write the execution statistics as JSON on exit"
+              << "\n"
+              << CYAN << "--symbols=<file>" << RESET << "\t\t\t"
+              << "name the profiled routines with a symbol file from the assembler"
+              << "\n"
+              << CYAN << "--threads=<n>" << RESET << "\t\t\t\t"
+              << "use n threads for --batch, one per core by default"
+              << "\n"
+              << CYAN << "--timeout=<ms>" << RESET << "\t\t\t\t"
+              << "stop the machine after ms milliseconds"
+              << "\n"
+              << CYAN << "--trace=<file>" << RESET << "\t\t\t\t"
+              << "record every executed instruction in a binary trace"
+              << RESET << "\n\n\n"
               << "For more information about a flag, digit --help [name of the flag]\n"
               << "for example --help --fast-mode";
 }
@@ -227,7 +715,7 @@ void print_help_for_flag(const std::string &flag)
                   << CYAN << "\t--boot <file>" << RESET << "\n"
                   << "Aliases:\n"
                   << CYAN << "\t-b" << RESET << "\n"
-                  << "The boot flag is used to specify a binary file that contains the software that will be executed first" << std::endl;
+                  << "The boot flag is used to specify a binary file that contains the software that will be executed first.\nImages up to 256 bytes are loaded in the ROM at 0xFF00, bigger images are loaded from address 0x0000. The UALf header, if present, is skipped" << std::endl;
         return;
     }
     if (flag == "-d" || flag == "--debug")
@@ -246,6 +734,15 @@ void print_help_for_flag(const std::string &flag)
                   << "This flag can be set only if --gpu=default is set. With this flag set, the GPU will load the default charmap which consists of the set of textures for ascii characters" << std::endl;
         return;
     }
+    if (flag == "--engine" || flag.starts_with("--engine="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--engine=<val>" << RESET << "\n"
+                  << YELLOW << "        =interpreter" << RESET << "\n"
+                  << YELLOW << "        =blocks" << RESET << "\n"
+                  << "This flag selects the execution engine of the CPU.\nThe interpreter runs one cached instruction at a time. The blocks engine translates the code into basic blocks, ending at jumps, calls, returns and syscalls, and runs each block as a chain of handlers.\nBoth engines produce the same machine state, blocks are invalidated when the memory page holding them is written" << std::endl;
+        return;
+    }
     if (flag == "--ext")
     {
         std::cout << "Usage:\n"
@@ -262,6 +759,99 @@ void print_help_for_flag(const std::string &flag)
                   << "The emulator will start in fast mode.\nIn this mode audio and video are disabled, the emulated BIOS stdout will be redirected to the host stdout, same for the stdin.\nUse this mode only to test CLI programs and with standard ANC BIOS and OS.\nYou can use this mode in combination with debug mode" << std::endl;
         return;
     }
+    if (flag == "--batch" || flag.starts_with("--batch="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--batch=<file>" << RESET << "\n"
+                  << "The file lists one boot image per line. Every image runs on its own machine like with --headless, many machines at once on a pool of threads (see --threads), each one a slice at a time (see --slice).\n--max-instructions applies to every machine, --timeout is ignored.\nA line is printed for every image with its exit code and the number of instructions it ran" << std::endl;
+        return;
+    }
+    if (flag == "--threads" || flag.starts_with("--threads="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--threads=<n>" << RESET << "\n"
+                  << "Number of threads running the machines of --batch. With 0, the default, there is one thread per core" << std::endl;
+        return;
+    }
+    if (flag == "--headless")
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--headless" << RESET << "\n"
+                  << "The emulator runs the boot image in fast mode and at max speed, without creating any window, audio or keyboard device.\nThe machine runs on the main thread until it executes KILL or exits through the exit syscall, or until the budget given by --max-instructions or --timeout runs out.\nThe process exit code is the value of R0" << std::endl;
+        return;
+    }
+    if (flag == "--max-instructions" || flag.starts_with("--max-instructions="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--max-instructions=<n>" << RESET << "\n"
+                  << "The machine is stopped after executing n instructions. The check is done every time slice (see --slice), so a few more instructions may run" << std::endl;
+        return;
+    }
+    if (flag == "--history" || flag.starts_with("--history=") || flag == "--checkpoint-interval" || flag.starts_with("--checkpoint-interval="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--history=<n>" << RESET << "\n"
+                  << CYAN << "\t--checkpoint-interval=<n>" << RESET << "\n"
+                  << "In debug mode the emulator records the execution so that the rs, rc and goto commands can go back in time.\nA checkpoint of the CPU and memory is taken every --checkpoint-interval instructions (default 100000) and the values read from devices in between are logged. Only the last --history checkpoints are kept (default 32), older history is dropped.\nA checkpoint only copies the memory pages written since the previous one. Devices are not rewound" << std::endl;
+        return;
+    }
+    if (flag == "--state" || flag.starts_with("--state="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--state=<file>" << RESET << "\n"
+                  << "The machine starts from the snapshot in the file, saved with the 'save state' debug command, instead of the reset state.\nThe boot image, if given, is loaded first and then replaced by the snapshot memory. The devices must be the same ones the snapshot was taken with" << std::endl;
+        return;
+    }
+    if (flag == "--profile" || flag.starts_with("--profile=") || flag == "--profile-interval" || flag.starts_with("--profile-interval=") || flag == "--symbols" || flag.starts_with("--symbols="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--profile=<file>" << RESET << "\n"
+                  << CYAN << "\t--profile-interval=<cycles>" << RESET << "\n"
+                  << CYAN << "\t--symbols=<file>" << RESET << "\n"
+                  << "Every --profile-interval emulated cycles (default 1000) the pc and the routines being called are sampled. The call stack is followed through call/ret and phpc/popc, a phpc frame starts at the target of the jump after it.\nWhen the machine stops the samples are written to the file as collapsed stacks with the emulated cycles of each, ready for flame graph tools (e.g. flamegraph.pl). Routines are named with the labels in the --symbols file, written by the assembler with --symbols, and by address without it.\nProfiling uses the interpreter even with --engine=blocks" << std::endl;
+        return;
+    }
+    if (flag == "--stats" || flag.starts_with("--stats="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--stats=<file>" << RESET << "\n"
+                  << "When the emulator exits it writes to the file, as JSON, how many times each opcode and addressing mode ran, how often each conditional jump was taken, the internal memory bytes read and written in every 4 KiB region and the bus transactions with the devices. The 'stats' debug command prints the same numbers.\nThe counters are only built in with 'cmake -DANC216_STATS=ON', otherwise they cost nothing and the file only says they are disabled" << std::endl;
+        return;
+    }
+    if (flag == "--trace" || flag.starts_with("--trace="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--trace=<file>" << RESET << "\n"
+                  << "Every instruction and interrupt is recorded in the file with the registers it changed and the bytes it wrote to the internal memory.\nThe trace is binary, the disassembler turns it into text with 'disassembler --trace <file>'. Tracing uses the interpreter even with --engine=blocks. After going back in the debug console the trace goes on from the restored state" << std::endl;
+        return;
+    }
+    if (flag == "--timeout" || flag.starts_with("--timeout="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--timeout=<ms>" << RESET << "\n"
+                  << "The machine is stopped after running for ms milliseconds of host time" << std::endl;
+        return;
+    }
+    if (flag == "--frames" || flag.starts_with("--frames=") || flag == "--frame-format" || flag.starts_with("--frame-format=") || flag == "--frame-interval" || flag.starts_with("--frame-interval=") || flag == "--frame-hashes" || flag.starts_with("--frame-hashes="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--frames=<path>" << RESET << "\n"
+                  << CYAN << "\t--frame-format=<val>" << RESET << "\n"
+                  << YELLOW << "\t              =ppm" << RESET << "\n"
+                  << YELLOW << "\t              =png" << RESET << "\n"
+                  << YELLOW << "\t              =raw" << RESET << "\n"
+                  << CYAN << "\t--frame-interval=<n>" << RESET << "\n"
+                  << CYAN << "\t--frame-hashes=<file>" << RESET << "\n"
+                  << "The AVC64 draws into memory instead of a window, so these flags also work with --headless.\nA frame is dumped every --frame-interval frames and whenever the guest writes the FD operation of the card (see doc/avc64.txt). With ppm and png the frame number is appended to the path (e.g. --frames=out/frame writes out/frame000060.ppm), with raw every frame is appended to the file as width * height * 3 bytes.\nWith --frame-hashes a line is written for every frame with its number and the XXH64 of its RGB24 pixels in hexadecimal, the same value xxhsum gives for a raw frame. Tests can compare it with golden hashes without dumping any image" << std::endl;
+        return;
+    }
+    if (flag == "--noaudio")
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--noaudio" << RESET << "\n"
+                  << "The audio card stays mapped and runs as usual, but its samples are dropped instead of being played. It's implied by --fast-mode and --headless" << std::endl;
+        return;
+    }
     if (flag == "--gpu" || flag.starts_with("--gpu="))
     {
         std::cout << "Usage:\n"
@@ -270,6 +860,26 @@ void print_help_for_flag(const std::string &flag)
                   << "This flag allows you specify wich GPU to emulate.\nThe default value is AVC64" << std::endl;
         return;
     }
+    if (flag == "--speed" || flag.starts_with("--speed="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--speed=<val>" << RESET << "\n"
+                  << YELLOW << "       =0.1" << RESET << "\n"
+                  << YELLOW << "       =0.5" << RESET << "\n"
+                  << YELLOW << "       =1" << RESET << "\n"
+                  << YELLOW << "       =2" << RESET << "\n"
+                  << YELLOW << "       =5" << RESET << "\n"
+                  << YELLOW << "       =max" << RESET << "\n"
+                  << "This flag sets the emulation speed as a multiple of the " << CPU_CLOCK_HZ / 1'000'000 << " MHz clock of the ANC216.\nWith max the emulator never waits and runs as fast as the host allows" << std::endl;
+        return;
+    }
+    if (flag == "--slice" || flag.starts_with("--slice="))
+    {
+        std::cout << "Usage:\n"
+                  << CYAN << "\t--slice=<cycles>" << RESET << "\n"
+                  << "The emulator runs this many clock cycles at once and then waits until the time they would take on the real machine has passed.\nThe default value is 1000" << std::endl;
+        return;
+    }
     std::cerr << RED << "cli:error" << RESET << " unrecognized flag " << flag << std::endl;
     exit(EXIT_FAILURE);
 }
\ No newline at end of file
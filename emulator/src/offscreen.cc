@@ -0,0 +1,245 @@
+#include <offscreen.hh>
+#include <hash.hh>
+#include <common.hh>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <iostream>
+
+ANC216::Video::Offscreen::Offscreen(const std::string &path, FrameFormat format, uint64_t interval, const std::string &hashfile)
+    : path(path), format(format), interval(interval), hashfile(hashfile)
+{
+}
+
+void ANC216::Video::Offscreen::open(int width, int height, const EmuFlags &)
+{
+    frame.width = width;
+    frame.height = height;
+    frame.pixels.assign((size_t)width * height, 0xFF000000);
+    rgb_valid = hash_valid = false;
+
+    if (path != "" && format == FRAME_RAW)
+    {
+        raw.open(path, std::ios::binary | std::ios::trunc);
+        if (!raw.is_open())
+            fail("cannot open " + path);
+    }
+    if (hashfile != "")
+    {
+        hashes.open(hashfile, std::ios::trunc);
+        if (!hashes.is_open())
+            fail("cannot open " + hashfile);
+    }
+}
+
+void ANC216::Video::Offscreen::update_rows(int width, int height, int row, int count, const uint32_t *pixels)
+{
+    if (width != frame.width || height != frame.height)
+    {
+        frame.width = width;
+        frame.height = height;
+        frame.pixels.assign((size_t)width * height, 0xFF000000);
+    }
+    std::copy(pixels, pixels + (size_t)width * count, &frame.pixels[(size_t)row * width]);
+    rgb_valid = hash_valid = false;
+}
+
+// The rows of a frame are all updated before its end, so the picture is
+// complete here. A capture asked during a frame saves that frame
+void ANC216::Video::Offscreen::end_frame()
+{
+    frames++;
+    if (failed)
+        return;
+
+    if (hashes.is_open())
+    {
+        char line[40];
+        snprintf(line, sizeof(line), "%06llu %016llx\n", (unsigned long long)frames, (unsigned long long)get_hash());
+        hashes << line << std::flush;
+        if (!hashes)
+            fail("cannot write " + hashfile);
+    }
+
+    bool periodic = interval != 0 && frames % interval == 0;
+    if (path != "" && (periodic || capture_requested))
+        dump();
+    capture_requested = false;
+}
+
+void ANC216::Video::Offscreen::capture()
+{
+    capture_requested = true;
+}
+
+uint64_t ANC216::Video::Offscreen::get_hash()
+{
+    if (!hash_valid)
+    {
+        auto &bytes = to_rgb();
+        hash = xxh64(bytes.data(), bytes.size());
+        hash_valid = true;
+    }
+    return hash;
+}
+
+const ANC216::Video::Frame &ANC216::Video::Offscreen::get_frame() const
+{
+    return frame;
+}
+
+uint64_t ANC216::Video::Offscreen::get_frames() const
+{
+    return frames;
+}
+
+const std::vector<uint8_t> &ANC216::Video::Offscreen::to_rgb()
+{
+    if (rgb_valid)
+        return rgb;
+    rgb.resize(frame.pixels.size() * 3);
+    uint8_t *out = rgb.data();
+    for (uint32_t pixel : frame.pixels)
+    {
+        *out++ = pixel >> 16;
+        *out++ = pixel >> 8;
+        *out++ = pixel;
+    }
+    rgb_valid = true;
+    return rgb;
+}
+
+void ANC216::Video::Offscreen::dump()
+{
+    if (format == FRAME_RAW)
+    {
+        auto &bytes = to_rgb();
+        raw.write((const char *)bytes.data(), bytes.size());
+        raw.flush();
+        if (!raw)
+            fail("cannot write " + path);
+        return;
+    }
+
+    char number[24];
+    snprintf(number, sizeof(number), "%06llu", (unsigned long long)frames);
+    write_image(path + number + (format == FRAME_PNG ? ".png" : ".ppm"));
+}
+
+// Built at compile time, the runner writes frames from several threads
+static constexpr std::array<uint32_t, 256> crc32_table = []
+{
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320 ^ c >> 1 : c >> 1;
+        table[i] = c;
+    }
+    return table;
+}();
+
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ crc >> 8;
+    return ~crc;
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t value)
+{
+    out.push_back(value >> 24);
+    out.push_back(value >> 16);
+    out.push_back(value >> 8);
+    out.push_back(value);
+}
+
+static void put_chunk(std::ostream &file, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    put32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put32(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    file.write((const char *)chunk.data(), chunk.size());
+}
+
+// The image data isn't compressed, it's stored in deflate blocks without
+// compression so that no zlib is needed. The files are as big as a PPM
+static void write_png(std::ostream &file, int width, int height, const uint8_t *rgb)
+{
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write((const char *)signature, sizeof(signature));
+
+    std::vector<uint8_t> header;
+    put32(header, width);
+    put32(header, height);
+    // 8 bits per channel, RGB, no interlace
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    put_chunk(file, "IHDR", header);
+
+    // Every row starts with its filter, 0 is none
+    size_t stride = (size_t)width * 3;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((stride + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        scanlines.push_back(0);
+        scanlines.insert(scanlines.end(), rgb + y * stride, rgb + (y + 1) * stride);
+    }
+
+    std::vector<uint8_t> data = {0x78, 0x01};
+    uint32_t a = 1, b = 0;
+    for (size_t offset = 0; offset < scanlines.size() || offset == 0;)
+    {
+        size_t size = std::min<size_t>(scanlines.size() - offset, UINT16_MAX);
+        bool last = offset + size == scanlines.size();
+        data.push_back(last);
+        data.push_back(size);
+        data.push_back(size >> 8);
+        data.push_back(~size);
+        data.push_back(~size >> 8);
+        data.insert(data.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+        offset += size;
+        if (last)
+            break;
+    }
+    for (uint8_t byte : scanlines)
+    {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    put32(data, b << 16 | a);
+    put_chunk(file, "IDAT", data);
+    put_chunk(file, "IEND", {});
+}
+
+void ANC216::Video::Offscreen::write_image(const std::string &filename)
+{
+    std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+        fail("cannot open " + filename);
+        return;
+    }
+
+    auto &bytes = to_rgb();
+    if (format == FRAME_PNG)
+        write_png(file, frame.width, frame.height, bytes.data());
+    else
+    {
+        file << "P6\n" << frame.width << " " << frame.height << "\n255\n";
+        file.write((const char *)bytes.data(), bytes.size());
+    }
+    if (!file)
+        fail("cannot write " + filename);
+}
+
+// The machine keeps running without the dumps
+void ANC216::Video::Offscreen::fail(const std::string &message)
+{
+    std::cerr << RED << "emu::error " << RESET << message << std::endl;
+    failed = true;
+}
@@ -0,0 +1,303 @@
+#include <pixels.hh>
+
+#if ANC216_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSE2_TARGET
+#define AVX2_TARGET
+#else
+#define SSE2_TARGET __attribute__((target("sse2")))
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+// -- Scalar, also used for the pixels left after the last full vector
+
+static void palette_scalar(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = palette[in[i]];
+}
+
+static void fill_scalar(uint8_t *out, uint8_t value, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = value;
+}
+
+static void unpack_scalar(const uint8_t *in, uint8_t *out, size_t count, int bits)
+{
+    uint8_t mask = (1 << bits) - 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t bit = i * bits;
+        out[i] = in[bit / 8] >> (8 - bits - bit % 8) & mask;
+    }
+}
+
+static void select_scalar(const uint8_t *in, uint8_t *out, size_t count, uint8_t one, uint8_t zero)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = in[i] != 0 ? one : zero;
+}
+
+static void masked_copy_scalar(const uint8_t *in, const uint8_t *mask, uint8_t *out, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        out[i] = (in[i] & mask[i]) | (out[i] & ~mask[i]);
+}
+
+static const ANC216::PixelKernels scalar_kernels = {
+    "scalar",
+    palette_scalar,
+    fill_scalar,
+    unpack_scalar,
+    select_scalar,
+    masked_copy_scalar,
+};
+
+#if ANC216_X86
+
+// -- SSE2
+
+// SSE2 has no gather, the lookups are scalar and only the stores are wide
+SSE2_TARGET static void palette_sse2(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128i colors = _mm_set_epi32(palette[in[i + 3]], palette[in[i + 2]], palette[in[i + 1]], palette[in[i]]);
+        _mm_storeu_si128((__m128i *)(out + i), colors);
+    }
+    palette_scalar(in + i, out + i, count - i, palette);
+}
+
+SSE2_TARGET static void fill_sse2(uint8_t *out, uint8_t value, size_t count)
+{
+    __m128i v = _mm_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    fill_scalar(out + i, value, count - i);
+}
+
+// Every byte of v holds one value of width bits. Each step splits them in
+// two values of half the width, the high one first, until they are bits
+// wide: 16 bytes of 1 bit pixels become 128 bytes
+SSE2_TARGET static void split_sse2(__m128i v, int width, int bits, uint8_t *&out)
+{
+    if (width == bits)
+    {
+        _mm_storeu_si128((__m128i *)out, v);
+        out += 16;
+        return;
+    }
+    int half = width / 2;
+    __m128i mask = _mm_set1_epi8((1 << half) - 1);
+    __m128i high = _mm_and_si128(_mm_srli_epi16(v, half), mask);
+    __m128i low = _mm_and_si128(v, mask);
+    split_sse2(_mm_unpacklo_epi8(high, low), half, bits, out);
+    split_sse2(_mm_unpackhi_epi8(high, low), half, bits, out);
+}
+
+SSE2_TARGET static void unpack_sse2(const uint8_t *in, uint8_t *out, size_t count, int bits)
+{
+    size_t per_block = 128 / bits;
+    size_t i = 0;
+    for (; i + per_block <= count; i += per_block, in += 16)
+        split_sse2(_mm_loadu_si128((const __m128i *)in), 8, bits, out);
+    unpack_scalar(in, out, count - i, bits);
+}
+
+SSE2_TARGET static void select_sse2(const uint8_t *in, uint8_t *out, size_t count, uint8_t one, uint8_t zero)
+{
+    __m128i ones = _mm_set1_epi8(one);
+    __m128i zeros = _mm_set1_epi8(zero);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i is_zero = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(in + i)), _mm_setzero_si128());
+        __m128i v = _mm_or_si128(_mm_and_si128(is_zero, zeros), _mm_andnot_si128(is_zero, ones));
+        _mm_storeu_si128((__m128i *)(out + i), v);
+    }
+    select_scalar(in + i, out + i, count - i, one, zero);
+}
+
+SSE2_TARGET static void masked_copy_sse2(const uint8_t *in, const uint8_t *mask, uint8_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        __m128i m = _mm_loadu_si128((const __m128i *)(mask + i));
+        __m128i src = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i dst = _mm_loadu_si128((const __m128i *)(out + i));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(_mm_and_si128(m, src), _mm_andnot_si128(m, dst)));
+    }
+    masked_copy_scalar(in + i, mask + i, out + i, count - i);
+}
+
+static const ANC216::PixelKernels sse2_kernels = {
+    "sse2",
+    palette_sse2,
+    fill_sse2,
+    unpack_sse2,
+    select_sse2,
+    masked_copy_sse2,
+};
+
+// -- AVX2, compiled for AVX2 without changing the flags of the others
+
+AVX2_TARGET static void palette_avx2(const uint8_t *in, uint32_t *out, size_t count, const uint32_t *palette)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + i)));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_i32gather_epi32((const int *)palette, indices, 4));
+    }
+    _mm256_zeroupper();
+    palette_scalar(in + i, out + i, count - i, palette);
+}
+
+AVX2_TARGET static void fill_avx2(uint8_t *out, uint8_t value, size_t count)
+{
+    __m256i v = _mm256_set1_epi8(value);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+        _mm256_storeu_si256((__m256i *)(out + i), v);
+    _mm256_zeroupper();
+    fill_scalar(out + i, value, count - i);
+}
+
+// Like split_sse2, but the AVX2 unpacks work inside each 128 bit lane, so
+// the halves are put back in order before going on
+AVX2_TARGET static void split_avx2(__m256i v, int width, int bits, uint8_t *&out)
+{
+    if (width == bits)
+    {
+        _mm256_storeu_si256((__m256i *)out, v);
+        out += 32;
+        return;
+    }
+    int half = width / 2;
+    __m256i mask = _mm256_set1_epi8((1 << half) - 1);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(v, half), mask);
+    __m256i low = _mm256_and_si256(v, mask);
+    __m256i a = _mm256_unpacklo_epi8(high, low);
+    __m256i b = _mm256_unpackhi_epi8(high, low);
+    split_avx2(_mm256_permute2x128_si256(a, b, 0x20), half, bits, out);
+    split_avx2(_mm256_permute2x128_si256(a, b, 0x31), half, bits, out);
+}
+
+AVX2_TARGET static void unpack_avx2(const uint8_t *in, uint8_t *out, size_t count, int bits)
+{
+    size_t per_block = 256 / bits;
+    size_t i = 0;
+    for (; i + per_block <= count; i += per_block, in += 32)
+        split_avx2(_mm256_loadu_si256((const __m256i *)in), 8, bits, out);
+    _mm256_zeroupper();
+    unpack_sse2(in, out, count - i, bits);
+}
+
+AVX2_TARGET static void select_avx2(const uint8_t *in, uint8_t *out, size_t count, uint8_t one, uint8_t zero)
+{
+    __m256i ones = _mm256_set1_epi8(one);
+    __m256i zeros = _mm256_set1_epi8(zero);
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i is_zero = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(in + i)), _mm256_setzero_si256());
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_blendv_epi8(ones, zeros, is_zero));
+    }
+    _mm256_zeroupper();
+    select_sse2(in + i, out + i, count - i, one, zero);
+}
+
+AVX2_TARGET static void masked_copy_avx2(const uint8_t *in, const uint8_t *mask, uint8_t *out, size_t count)
+{
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i m = _mm256_loadu_si256((const __m256i *)(mask + i));
+        __m256i src = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i dst = _mm256_loadu_si256((const __m256i *)(out + i));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_blendv_epi8(dst, src, m));
+    }
+    _mm256_zeroupper();
+    masked_copy_sse2(in + i, mask + i, out + i, count - i);
+}
+
+static const ANC216::PixelKernels avx2_kernels = {
+    "avx2",
+    palette_avx2,
+    fill_avx2,
+    unpack_avx2,
+    select_avx2,
+    masked_copy_avx2,
+};
+
+// AVX2 also needs the OS to save the YMM registers
+static bool has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osxsave = info[2] & (1 << 27);
+    bool avx = info[2] & (1 << 28);
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return info[3] & (1 << 26);
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+#endif
+
+static const ANC216::PixelKernels &select_kernels()
+{
+#if ANC216_X86
+    if (has_avx2())
+        return avx2_kernels;
+    if (has_sse2())
+        return sse2_kernels;
+#endif
+    return scalar_kernels;
+}
+
+std::vector<const ANC216::PixelKernels *> ANC216::supported_pixel_kernels()
+{
+    std::vector<const PixelKernels *> sets = {&scalar_kernels};
+#if ANC216_X86
+    if (has_sse2())
+        sets.push_back(&sse2_kernels);
+    if (has_avx2())
+        sets.push_back(&avx2_kernels);
+#endif
+    return sets;
+}
+
+// Chosen the first time they are needed
+const ANC216::PixelKernels &ANC216::pixel_kernels()
+{
+    static const PixelKernels &kernels = select_kernels();
+    return kernels;
+}
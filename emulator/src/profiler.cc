@@ -0,0 +1,164 @@
+#include <profiler.hh>
+#include <isa.hh>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+ANC216::Profiler::Profiler(CPU &cpu, const std::string &filename, uint64_t interval)
+    : cpu(cpu), filename(filename), interval(interval)
+{
+    last_sample = cpu.cycles;
+    next_sample = cpu.cycles + interval;
+    key.reserve(MAX_DEPTH + 1);
+}
+
+// Symbol files have one label per line, the address in hexadecimal and
+// the name, as written by the assembler with --symbols
+void ANC216::Profiler::load_symbols(const std::string &filename)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open " + filename);
+
+    std::string line;
+    size_t number = 0;
+    while (std::getline(file, line))
+    {
+        number++;
+        std::stringstream fields(line);
+        std::string address, label;
+        if (!(fields >> address))
+            continue;
+        try
+        {
+            size_t end;
+            unsigned long value = std::stoul(address, &end, 16);
+            if (end != address.size() || value > UINT16_MAX || !(fields >> label))
+                throw std::invalid_argument(line);
+            symbols[value] = label;
+        }
+        catch (const std::logic_error &)
+        {
+            throw std::runtime_error(filename + ":" + std::to_string(number) + ": invalid symbol");
+        }
+    }
+}
+
+void ANC216::Profiler::push(uint16_t entry)
+{
+    if (stack.size() < MAX_DEPTH)
+        stack.push_back(entry);
+    else
+        hidden++;
+}
+
+void ANC216::Profiler::pop()
+{
+    pending_entry = false;
+    if (hidden > 0)
+        hidden--;
+    else if (!stack.empty())
+        stack.pop_back();
+}
+
+// Called after every instruction while profiling, with the opcode of the
+// instruction that ran, whether it jumped and the pc already moved to the
+// next one
+void ANC216::Profiler::after_instruction(uint8_t opcode, bool jumped)
+{
+    switch (opcode)
+    {
+    case CALL:
+        push(cpu.pc);
+        break;
+    case PHPC:
+        push(cpu.pc);
+        pending_entry = true;
+        break;
+    case RET:
+    case POPC:
+        pop();
+        break;
+    default:
+        // A conditional jump not taken isn't the one PHPC is waiting for
+        if (pending_entry && jumped && opcode >= JMP && opcode <= JNN)
+        {
+            if (hidden == 0 && !stack.empty())
+                stack.back() = cpu.pc;
+            pending_entry = false;
+        }
+    }
+
+    if (cpu.cycles >= next_sample)
+        sample();
+}
+
+// The interrupt handler runs as a routine called at the vector target and
+// returns with RET
+void ANC216::Profiler::enter_interrupt()
+{
+    push(cpu.pc);
+}
+
+// The stack doesn't match the guest anymore after restoring a snapshot or
+// going back in the history
+void ANC216::Profiler::clear_stack()
+{
+    stack.clear();
+    hidden = 0;
+    pending_entry = false;
+    last_sample = cpu.cycles;
+    next_sample = cpu.cycles + interval;
+}
+
+void ANC216::Profiler::sample()
+{
+    key.assign(stack.begin(), stack.end());
+    key.push_back(cpu.pc);
+    samples[key] += cpu.cycles - last_sample;
+    last_sample = cpu.cycles;
+    next_sample = cpu.cycles + interval;
+}
+
+// The label at or before the address, or the address itself when there
+// is none
+std::string ANC216::Profiler::name(uint16_t address)
+{
+    auto symbol = symbols.upper_bound(address);
+    if (symbol != symbols.begin())
+        return std::prev(symbol)->second;
+    std::stringstream hex;
+    hex << std::hex << std::setw(4) << std::setfill('0') << address;
+    return hex.str();
+}
+
+// Stacks are merged by name, so every address in a routine counts for its
+// label. The pc is only added as a frame when it's under another label
+// than the routine it's in
+void ANC216::Profiler::write()
+{
+    std::map<std::string, uint64_t> collapsed;
+    for (auto &[frames, cycles] : samples)
+    {
+        std::string line;
+        std::string last;
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            std::string frame = name(frames[i]);
+            if (i == frames.size() - 1 && frame == last)
+                break;
+            line += (line.empty() ? "" : ";") + frame;
+            last = frame;
+        }
+        collapsed[line] += cycles;
+    }
+
+    std::ofstream file(filename, std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open " + filename);
+    for (auto &[line, cycles] : collapsed)
+        file << line << " " << cycles << "\n";
+    if (!file)
+        throw std::runtime_error("cannot write " + filename);
+}
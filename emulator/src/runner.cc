@@ -0,0 +1,133 @@
+#include <runner.hh>
+#include <algorithm>
+#include <thread>
+
+// With 0 threads there is one per hardware thread
+ANC216::Runner::Runner(size_t threads, uint64_t slice_cycles)
+    : threads(threads), slice_cycles(slice_cycles)
+{
+    if (this->threads == 0)
+        this->threads = std::max(1u, std::thread::hardware_concurrency());
+}
+
+// The factory is called by the worker that starts the machine. Returns
+// the index of the result
+size_t ANC216::Runner::add(Factory factory)
+{
+    jobs.push_back(std::move(factory));
+    return jobs.size() - 1;
+}
+
+size_t ANC216::Runner::add(const EmuFlags &flags, const std::vector<uint8_t> &image)
+{
+    return add([flags, image]
+               {
+                   auto machine = std::make_unique<Machine>(flags);
+                   machine->load_boot_image(image);
+                   return machine; });
+}
+
+// The oldest machine of the worker, or a new one while it has less than
+// MACHINES_PER_WORKER
+bool ANC216::Runner::next_task(size_t id, Task &task)
+{
+    Worker &worker = *workers[id];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.size() >= MACHINES_PER_WORKER ||
+            (!worker.tasks.empty() && next_job >= jobs.size()))
+        {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+            return true;
+        }
+    }
+
+    size_t job = next_job++;
+    if (job < jobs.size())
+    {
+        task.job = job;
+        task.machine = jobs[job]();
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty())
+        return false;
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    return true;
+}
+
+// Takes from the back, the machine its owner would run last
+bool ANC216::Runner::steal(size_t id, Task &task)
+{
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker &victim = *workers[(id + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty())
+            continue;
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+    }
+    return false;
+}
+
+void ANC216::Runner::work(size_t id)
+{
+    while (remaining > 0)
+    {
+        Task task;
+        try
+        {
+            // No job left to start and nothing to steal: the last machines
+            // are running on other workers, which keep them. No new
+            // machine can show up, so the worker is done
+            if (!next_task(id, task) && !steal(id, task))
+                return;
+
+            if (task.machine->run(slice_cycles))
+            {
+                std::lock_guard<std::mutex> lock(workers[id]->mutex);
+                workers[id]->tasks.push_back(std::move(task));
+                continue;
+            }
+            results[task.job] = task.machine->result();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (error == nullptr)
+                error = std::current_exception();
+        }
+        remaining--;
+    }
+}
+
+// Returns when every machine finished, the results in the order the jobs
+// were added. The first exception thrown by a factory or a machine is
+// thrown again here, after the others finished
+std::vector<ANC216::MachineResult> ANC216::Runner::run()
+{
+    results.assign(jobs.size(), MachineResult());
+    workers.clear();
+    for (size_t i = 0; i < threads; i++)
+        workers.push_back(std::make_unique<Worker>());
+    next_job = 0;
+    remaining = jobs.size();
+    error = nullptr;
+
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++)
+        pool.emplace_back(&Runner::work, this, i);
+    work(0);
+    for (auto &thread : pool)
+        thread.join();
+
+    jobs.clear();
+    if (error != nullptr)
+        std::rethrow_exception(error);
+    return std::move(results);
+}
@@ -0,0 +1,41 @@
+#include <scheduler.hh>
+
+ANC216::EventId ANC216::Scheduler::schedule(uint64_t when, EventAction action)
+{
+    EventId id = next_id++;
+    events.push(Event{when, id, std::move(action)});
+    return id;
+}
+
+// Cancelled events stay in the heap and are dropped when they reach the top
+void ANC216::Scheduler::cancel(EventId id)
+{
+    cancelled.insert(id);
+}
+
+uint64_t ANC216::Scheduler::next_due()
+{
+    while (!events.empty() && cancelled.erase(events.top().id))
+        events.pop();
+    return events.empty() ? NO_EVENT : events.top().when;
+}
+
+// Actions get the cycle they were due at rather than the current one, so
+// periodic events don't drift when an instruction overshoots them
+void ANC216::Scheduler::run_due(uint64_t now)
+{
+    while (!events.empty() && events.top().when <= now)
+    {
+        Event event = events.top();
+        events.pop();
+        if (cancelled.erase(event.id))
+            continue;
+        event.action(event.when);
+    }
+}
+
+void ANC216::Scheduler::clear()
+{
+    events = {};
+    cancelled.clear();
+}
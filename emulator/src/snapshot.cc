@@ -0,0 +1,139 @@
+#include <snapshot.hh>
+#include <fstream>
+#include <stdexcept>
+
+#define SNAPSHOT_MAGIC "ANC216SS"
+#define SNAPSHOT_MAGIC_SIZE 8
+#define SNAPSHOT_VERSION 1
+
+// Numbers are stored big endian, like in the ANC216 memory
+static void put(std::ostream &file, uint64_t value, int size)
+{
+    for (int i = size - 1; i >= 0; i--)
+        file.put((char)(value >> (i * 8)));
+}
+
+static uint64_t get(std::istream &file, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        int byte = file.get();
+        if (byte == EOF)
+            throw std::runtime_error("unexpected end of the snapshot");
+        value = value << 8 | byte;
+    }
+    return value;
+}
+
+void ANC216::save_snapshot(const std::string &filename, const Snapshot &snapshot)
+{
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open " + filename);
+
+    file.write(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    put(file, SNAPSHOT_VERSION, 2);
+
+    for (int i = 0; i < 8; i++)
+        put(file, (uint16_t)snapshot.reg[i], 2);
+    put(file, snapshot.sr, 1);
+    put(file, snapshot.sp, 2);
+    put(file, snapshot.bp, 2);
+    put(file, snapshot.pc, 2);
+    put(file, snapshot.current_instruction, 2);
+    for (int i = 0; i < 6; i++)
+        put(file, snapshot.mtu[i], 2);
+    put(file, snapshot.cpid, 2);
+    put(file, snapshot.cycles, 8);
+    put(file, snapshot.instructions, 8);
+    put(file, snapshot.pending_interrupts, 1);
+    put(file, snapshot.nmi_code, 1);
+    put(file, snapshot.timer.period, 8);
+    put(file, snapshot.timer.due, 8);
+    put(file, snapshot.timer.running, 1);
+
+    for (auto &page : snapshot.imem)
+        file.write((const char *)page->data(), PAGE_SIZE);
+
+    put(file, snapshot.responses.size(), 4);
+    for (auto &response : snapshot.responses)
+    {
+        put(file, response.address, 2);
+        put(file, response.data, 2);
+        put(file, response.type, 1);
+    }
+
+    put(file, snapshot.devices.size(), 4);
+    for (auto &device : snapshot.devices)
+    {
+        put(file, device.size(), 4);
+        file.write((const char *)device.data(), device.size());
+    }
+
+    if (!file)
+        throw std::runtime_error("cannot write " + filename);
+}
+
+ANC216::Snapshot ANC216::load_snapshot(const std::string &filename)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open " + filename);
+
+    char magic[SNAPSHOT_MAGIC_SIZE];
+    file.read(magic, SNAPSHOT_MAGIC_SIZE);
+    if (!file || std::string(magic, SNAPSHOT_MAGIC_SIZE) != SNAPSHOT_MAGIC)
+        throw std::runtime_error(filename + " is not a snapshot");
+    if (get(file, 2) != SNAPSHOT_VERSION)
+        throw std::runtime_error("unsupported snapshot version");
+
+    Snapshot snapshot;
+    for (int i = 0; i < 8; i++)
+        snapshot.reg[i] = get(file, 2);
+    snapshot.sr = get(file, 1);
+    snapshot.sp = get(file, 2);
+    snapshot.bp = get(file, 2);
+    snapshot.pc = get(file, 2);
+    snapshot.current_instruction = get(file, 2);
+    for (int i = 0; i < 6; i++)
+        snapshot.mtu[i] = get(file, 2);
+    snapshot.cpid = get(file, 2);
+    snapshot.cycles = get(file, 8);
+    snapshot.instructions = get(file, 8);
+    snapshot.pending_interrupts = get(file, 1);
+    snapshot.nmi_code = get(file, 1);
+    snapshot.timer.period = get(file, 8);
+    snapshot.timer.due = get(file, 8);
+    snapshot.timer.running = get(file, 1);
+
+    for (auto &page : snapshot.imem)
+    {
+        auto data = std::make_shared<MemoryPage>();
+        file.read((char *)data->data(), PAGE_SIZE);
+        if (!file)
+            throw std::runtime_error("unexpected end of the snapshot");
+        page = data;
+    }
+
+    uint32_t responses = get(file, 4);
+    for (uint32_t i = 0; i < responses; i++)
+    {
+        BusResponse response;
+        response.address = get(file, 2);
+        response.data = get(file, 2);
+        response.type = (BusRequest)get(file, 1);
+        snapshot.responses.push_back(response);
+    }
+
+    uint32_t devices = get(file, 4);
+    for (uint32_t i = 0; i < devices; i++)
+    {
+        std::vector<uint8_t> state(get(file, 4));
+        file.read((char *)state.data(), state.size());
+        if (!file)
+            throw std::runtime_error("unexpected end of the snapshot");
+        snapshot.devices.push_back(std::move(state));
+    }
+    return snapshot;
+}
@@ -0,0 +1,77 @@
+#include <common.hh>
+#include <timer.hh>
+
+#define CYCLES_PER_MS (CPU_CLOCK_HZ / 1000)
+
+ANC216::Timer::Timer(Scheduler &scheduler, std::function<void()> on_expire) : scheduler(scheduler), on_expire(std::move(on_expire))
+{
+}
+
+void ANC216::Timer::arm(uint64_t from)
+{
+    due = from + period;
+    schedule();
+}
+
+void ANC216::Timer::schedule()
+{
+    event = scheduler.schedule(due, [this](uint64_t when)
+                               {
+                                   if (period == 0)
+                                       running = false;
+                                   else
+                                       arm(when);
+                                   on_expire(); });
+}
+
+// A new period takes effect at the next expiry
+void ANC216::Timer::set_period(uint16_t ms)
+{
+    period = (uint64_t)ms * CYCLES_PER_MS;
+}
+
+void ANC216::Timer::start(uint64_t now)
+{
+    stop();
+    if (period == 0)
+        return;
+    running = true;
+    arm(now);
+}
+
+void ANC216::Timer::stop()
+{
+    if (!running)
+        return;
+    scheduler.cancel(event);
+    running = false;
+}
+
+bool ANC216::Timer::is_running()
+{
+    return running;
+}
+
+// Milliseconds left before the next expiry, rounded up
+uint16_t ANC216::Timer::remaining(uint64_t now)
+{
+    if (!running || now >= due)
+        return 0;
+    return (due - now + CYCLES_PER_MS - 1) / CYCLES_PER_MS;
+}
+
+ANC216::TimerState ANC216::Timer::save_state()
+{
+    return TimerState{period, due, running};
+}
+
+// The scheduler is expected to be cleared before, the pending expiry is
+// scheduled again from the saved state
+void ANC216::Timer::load_state(const TimerState &state)
+{
+    period = state.period;
+    due = state.due;
+    running = state.running;
+    if (running)
+        schedule();
+}
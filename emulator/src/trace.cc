@@ -0,0 +1,156 @@
+#include <trace.hh>
+#include <stdexcept>
+
+static void put(std::vector<uint8_t> &record, uint16_t value)
+{
+    record.push_back(value >> 8);
+    record.push_back(value & 0xFF);
+}
+
+ANC216::Tracer::Tracer(CPU &cpu, const std::string &filename) : cpu(cpu)
+{
+    file.open(filename, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("cannot open " + filename);
+    file.write(TRACE_MAGIC, TRACE_MAGIC_SIZE);
+    file.put(TRACE_VERSION >> 8);
+    file.put(TRACE_VERSION & 0xFF);
+    for (auto &buffer : buffers)
+        buffer.reserve(BUFFER_SIZE);
+    writer = std::thread([this]
+                         { write_buffers(); });
+}
+
+ANC216::Tracer::~Tracer()
+{
+    close();
+}
+
+void ANC216::Tracer::save_registers(uint8_t sr)
+{
+    std::copy(cpu.reg, cpu.reg + 8, old_reg);
+    old_sp = cpu.sp;
+    old_bp = cpu.bp;
+    old_sr = sr;
+    writes.clear();
+    write_count = 0;
+    recording = true;
+}
+
+void ANC216::Tracer::before_instruction(uint8_t sr)
+{
+    DecodedInstruction &ins = cpu.decode_cache[cpu.pc];
+    if (!ins.valid)
+        cpu.decode(cpu.pc, ins);
+
+    record.clear();
+    record.push_back(TRACE_INSTRUCTION);
+    put(record, cpu.pc);
+    record.push_back(ins.length);
+    for (uint8_t i = 0; i < ins.length; i++)
+        record.push_back(cpu.imem[(uint16_t)(cpu.pc + i)]);
+    save_registers(sr);
+}
+
+void ANC216::Tracer::before_interrupt(uint8_t source, uint8_t sr)
+{
+    record.clear();
+    record.push_back(TRACE_INTERRUPT);
+    record.push_back(source);
+    put(record, cpu.pc);
+    save_registers(sr);
+}
+
+// Completes the record with what changed since before_instruction or
+// before_interrupt and queues it
+void ANC216::Tracer::after(uint8_t sr)
+{
+    recording = false;
+    uint16_t mask = 0;
+    for (int i = 0; i < 8; i++)
+        if (cpu.reg[i] != old_reg[i])
+            mask |= 1 << i;
+    if (cpu.sp != old_sp)
+        mask |= 1 << TRACE_SP;
+    if (cpu.bp != old_bp)
+        mask |= 1 << TRACE_BP;
+    if (sr != old_sr)
+        mask |= 1 << TRACE_SR;
+
+    put(record, mask);
+    for (int i = 0; i < 8; i++)
+        if (mask & 1 << i)
+            put(record, cpu.reg[i]);
+    if (mask & 1 << TRACE_SP)
+        put(record, cpu.sp);
+    if (mask & 1 << TRACE_BP)
+        put(record, cpu.bp);
+    if (mask & 1 << TRACE_SR)
+        record.push_back(sr);
+    put(record, write_count);
+
+    if (buffers[head].size() + record.size() + writes.size() > BUFFER_SIZE)
+        submit();
+    buffers[head].insert(buffers[head].end(), record.begin(), record.end());
+    buffers[head].insert(buffers[head].end(), writes.begin(), writes.end());
+}
+
+// Hands the buffer being filled to the writer and moves to the next one,
+// waiting if the writer hasn't emptied it yet
+void ANC216::Tracer::submit()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    queued++;
+    changed.notify_all();
+    changed.wait(lock, [this]
+                 { return queued < BUFFERS; });
+    head = (head + 1) % BUFFERS;
+}
+
+void ANC216::Tracer::write_buffers()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        changed.wait(lock, [this]
+                     { return queued > 0 || closing; });
+        if (queued == 0)
+            return;
+        std::vector<uint8_t> &buffer = buffers[tail];
+        lock.unlock();
+        file.write((const char *)buffer.data(), buffer.size());
+        buffer.clear();
+        lock.lock();
+        tail = (tail + 1) % BUFFERS;
+        queued--;
+        changed.notify_all();
+    }
+}
+
+// Writes everything recorded so far, called from the CPU thread or while
+// the CPU is stopped
+void ANC216::Tracer::flush()
+{
+    if (!writer.joinable())
+        return;
+    if (!buffers[head].empty())
+        submit();
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this]
+                 { return queued == 0; });
+    file.flush();
+}
+
+void ANC216::Tracer::close()
+{
+    if (!writer.joinable())
+        return;
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    changed.notify_all();
+    writer.join();
+    file.close();
+}
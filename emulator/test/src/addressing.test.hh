@@ -0,0 +1,31 @@
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+// The index register of the indexed modes is a signed byte, like the
+// offsets of the relative modes
+void addressing_test()
+{
+    using namespace ANC216;
+    Program program;
+    program.imm(LOAD, 1, 0xFFFE)
+        .indexed(LOAD, 1, 0x1002)
+        .imm(LOAD, 2, 0xFFFE)
+        .emit(guest::indirect_indexed(2), LOAD, {0x10, 0x10})
+        .implied(KILL);
+
+    auto machine = make_machine(program);
+    machine->load_memory(0x1000, {0x12, 0x34});
+    machine->load_memory(0x1010, {0x10, 0x02});
+    machine->load_memory(0x1100, {0x56, 0x78});
+    run_to_end(*machine);
+
+    CPUInfo state = machine->get_state();
+    report("absolute indexed with a negative index", (uint16_t)state.reg[1] == 0x1234);
+    if ((uint16_t)state.reg[1] != 0x1234)
+        std::cerr << EXPECTED_BUT_GOT(0x1234, (uint16_t)state.reg[1]);
+    report("indirect indexed with a negative index", (uint16_t)state.reg[2] == 0x1234);
+    if ((uint16_t)state.reg[2] != 0x1234)
+        std::cerr << EXPECTED_BUT_GOT(0x1234, (uint16_t)state.reg[2]);
+}
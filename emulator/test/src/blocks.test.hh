@@ -0,0 +1,134 @@
+#include "interrupts.test.hh"
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_DEVICE_ADDR 0xFFF0
+
+// Answers every write with an EINR, as many cycles later as the value
+// written
+class DelayDevice : public ANC216::Device
+{
+public:
+    DelayDevice(ANC216::EmemMapper *emem, ANC216::EmuFlags flags) : Device(emem, flags)
+    {
+        this->id = ANC216::ROM;
+    }
+
+    void cpu_write(uint16_t value, bool) override
+    {
+        emem->schedule(emem->get_cycles() + value, [this](uint64_t when)
+                       { emem->respond(get_addr(), when & 0xFFFF, ANC216::DEVICE_REQUEST); });
+    }
+
+    uint16_t cpu_read(uint16_t, bool) override
+    {
+        return 0;
+    }
+};
+
+bool same_state(const ANC216::CPUInfo &a, const ANC216::CPUInfo &b)
+{
+    return std::equal(a.reg, a.reg + 8, b.reg) && a.sr == b.sr && a.sp == b.sp && a.bp == b.bp && a.pc == b.pc &&
+           a.cycles == b.cycles && a.instructions == b.instructions;
+}
+
+std::ostream &operator<<(std::ostream &out, const ANC216::CPUInfo &info)
+{
+    out << "pc " << info.pc << " cycles " << info.cycles << " instructions " << info.instructions << " registers";
+    for (int16_t value : info.reg)
+        out << " " << value;
+    return out;
+}
+
+// Runs the interpreter and the block engine side by side, comparing the
+// registers after every slice and the memory at the end
+bool same_as_interpreter(const std::string &name, std::unique_ptr<ANC216::Machine> machines[2])
+{
+    for (int slice = 0; slice < 1000; slice++)
+    {
+        bool running[2] = {machines[0]->run(1000), machines[1]->run(1000)};
+        ANC216::CPUInfo states[2] = {machines[0]->get_state(), machines[1]->get_state()};
+        if (!same_state(states[0], states[1]))
+        {
+            std::cerr << NO(name) << EXPECTED_BUT_GOT(states[0], states[1]);
+            failures++;
+            return false;
+        }
+        if (!running[0] || !running[1])
+            break;
+    }
+    bool same = machines[0]->read_memory(0, 0xFFFF) == machines[1]->read_memory(0, 0xFFFF);
+    report(name, same);
+    return same;
+}
+
+void blocks_test()
+{
+    using namespace ANC216;
+
+    // The timer goes off in the middle of a block and the handler kills
+    // the machine, which shows where the block was stopped
+    Program program;
+    program.word(TIME, 1).implied(TSTART);
+    uint16_t loop = program.here();
+    for (int i = 0; i < 40; i++)
+        program.reg(INC, 0);
+    program.word(JMP, loop);
+    Program kill(0x0100);
+    kill.implied(KILL);
+
+    std::unique_ptr<Machine> machines[2];
+    for (int i = 0; i < 2; i++)
+    {
+        machines[i] = make_machine(program, i == 1);
+        machines[i]->load_memory(kill.origin, kill.code);
+        machines[i]->load_memory(TEST_VECTOR_TIMER, {0x01, 0x00});
+        machines[i]->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    }
+    same_as_interpreter("block engine stops at the timer interrupt", machines);
+
+    for (int i = 0; i < 2; i++)
+        machines[i] = make_timer_machine(i == 1);
+    same_as_interpreter("block engine with a timer handler", machines);
+
+    // Bus responses at cycles the device chose, with the timer going on
+    // meanwhile. The EINR handler counts them in R6 and restores what the
+    // interrupt pushed
+    Program bus;
+    bus.word(LDSP, 0x2000).word(TIME, 2).implied(TSTART);
+    loop = bus.here();
+    for (int i = 0; i < 20; i++)
+        bus.reg(INC, 3);
+    bus.emit(0b00'001'110, WRITE, {TEST_DEVICE_ADDR >> 8, TEST_DEVICE_ADDR & 0xFF, 0, 37});
+    for (int i = 0; i < 15; i++)
+        bus.reg(INC, 3);
+    bus.reg(INC, 5)
+        .imm(CMP, 5, 300)
+        .word(JNE, loop)
+        .implied(KILL);
+    Program handlers(0x0100);
+    handlers.reg(INC, 4).implied(RET);
+    uint16_t einr = handlers.here();
+    handlers.reg(INC, 6)
+        .emit(guest::low_reg(2), POP)
+        .reg(POP, 1)
+        .reg(POP, 0)
+        .implied(RET);
+
+    for (int i = 0; i < 2; i++)
+    {
+        machines[i] = make_machine(bus, i == 1);
+        machines[i]->load_memory(handlers.origin, handlers.code);
+        machines[i]->load_memory(TEST_VECTOR_EINR, {(uint8_t)(einr >> 8), (uint8_t)einr});
+        machines[i]->load_memory(TEST_VECTOR_TIMER, {0x01, 0x00});
+        machines[i]->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+        machines[i]->map(TEST_DEVICE_ADDR, new DelayDevice(machines[i]->get_mapper(), machines[i]->get_flags()));
+    }
+    if (same_as_interpreter("block engine with bus responses and the timer", machines))
+    {
+        CPUInfo state = machines[1]->get_state();
+        report("every bus response reached the handler", machines[1]->finished() && state.reg[6] == 300 && state.reg[4] > 0);
+    }
+}
@@ -0,0 +1,22 @@
+#include <console.hh>
+#include <iostream>
+
+#pragma once
+
+#define OK(x) GREEN << "✓" << RESET << " Test " << x << " passed\n"
+#define NO(x) RED << "✗ Test " << x << " failed\n" << RESET
+#define EXPECTED_BUT_GOT(x, y) "\t" << "Expected " << x << " but got " << y << "\n"
+
+// Failed tests, main returns it so ctest sees the failures
+inline int failures = 0;
+
+inline void report(const std::string &name, bool passed)
+{
+    if (passed)
+    {
+        std::cout << OK(name);
+        return;
+    }
+    std::cerr << NO(name);
+    failures++;
+}
@@ -0,0 +1,78 @@
+#include <anc216.hh>
+#include "common.hh"
+
+#pragma once
+
+// The chain of tests the CPU decoded the addressing byte with before the
+// decode table, kept as the reference for it
+ANC216::AddressingMode reference_mode(uint8_t addr)
+{
+    using namespace ANC216;
+    if (addr == 0)
+        return IMPLIED_MODE;
+    if (addr == 0b00'001'000)
+        return IMMEDIATE_BYTE;
+    if (addr == 0b00'010'000)
+        return IMMEDIATE_WORD;
+    if ((addr & 0b11'000'111) == 0b00'000'001)
+        return REGISTER_ACCESS_MODE;
+    if ((addr & 0b11'000'111) == 0b00'000'010)
+        return LOW_REGISTER_ACCESS_MODE;
+    if ((addr & 0b11'000'000) == 0b01'000'000)
+        return REGISTER_TO_REGISTER_MODE;
+    if (addr == 0b10'000'000)
+        return MEMORY_ABSOULTE;
+    if ((addr & 0b11'000'111) == 0b10'000'001)
+        return MEMORY_ABSOULTE_INDEXED;
+    if (addr == 0b10'000'100)
+        return MEMORY_RELATIVE_TO_PC;
+    if (addr == 0b10'001'100)
+        return MEMORY_RELATIVE_TO_BP;
+    if ((addr & 0b11'000'111) == 0b10'000'101)
+        return MEMORY_RELATIVE_TO_PC_WITH_REGISTER;
+    if ((addr & 0b11'000'111) == 0b10'000'110)
+        return MEMORY_RELATIVE_TO_BP_WITH_REGISTER;
+    if (addr == 0b10'000'010)
+        return MEMORY_INDIRECT;
+    if ((addr & 0b11'000'111) == 0b10'000'011)
+        return MEMORY_INDIRECT_INDEXED;
+    if (addr == 0b11 || addr == 0b1011)
+        return IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP;
+    if ((addr & 0b11'000'111) == 0b00'000'100 || (addr & 0b11'000'111) == 0b00'000'101)
+        return IMMEDIATE_TO_MEMORY_RELATIVE_TO_BP_WITH_REGISTER;
+    if (addr == 0b110 || addr == 0b1110)
+        return IMMEDIATE_TO_MEMORY_ABSOLUTE;
+    if ((addr & 0b11'000'111) == 0b111)
+        return IMMEDIATE_TO_MEMORY_ABSOLUTE_INDEXED;
+    if ((addr & 0b11'000'111) == 0b11'000'000)
+        return MEMORY_ABSOULTE_TO_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'001)
+        return IMMEDIATE_TO_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'010)
+        return MEMORY_RELATIVE_TO_PC_TO_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'011)
+        return MEMORY_RELATIVE_TO_BP_TO_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'100)
+        return MEMORY_ABSOULTE_TO_LOW_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'101)
+        return IMMEDIATE_TO_LOW_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'110)
+        return MEMORY_RELATIVE_TO_PC_TO_LOW_REGISTER;
+    if ((addr & 0b11'000'111) == 0b11'000'111)
+        return MEMORY_RELATIVE_TO_BP_TO_LOW_REGISTER;
+    return NONE;
+}
+
+void decoder_test()
+{
+    int wrong = 0;
+    for (int addr = 0; addr < 256; addr++)
+    {
+        ANC216::AddressingMode mode = ANC216::CPU::addressing(addr).mode;
+        if (mode == reference_mode(addr))
+            continue;
+        if (wrong++ == 0)
+            std::cerr << EXPECTED_BUT_GOT(reference_mode(addr), mode) << "\tfor the addressing byte " << addr << "\n";
+    }
+    report("decode table against the old decoder", wrong == 0);
+}
@@ -0,0 +1,92 @@
+#include "interrupts.test.hh"
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_BATCH_ADDR 0xFFF0
+
+// Keeps what the mapper handed it. Requests are answered with the offset
+// of the address followed by the position in the batch
+class BatchDevice : public ANC216::Device
+{
+public:
+    std::vector<std::vector<uint16_t>> write_blocks;
+    std::vector<std::pair<uint16_t, size_t>> read_blocks;
+    int single_transfers = 0;
+
+    BatchDevice(ANC216::EmemMapper *emem, ANC216::EmuFlags flags) : Device(emem, flags)
+    {
+        this->id = ANC216::ROM;
+    }
+
+    void cpu_write(uint16_t, bool) override
+    {
+        single_transfers++;
+    }
+
+    uint16_t cpu_read(uint16_t, bool) override
+    {
+        single_transfers++;
+        return 0;
+    }
+
+    void cpu_write_block(const uint16_t *values, size_t count, bool) override
+    {
+        write_blocks.emplace_back(values, values + count);
+    }
+
+    void cpu_read_block(uint16_t offset, uint16_t *values, size_t count, bool) override
+    {
+        read_blocks.emplace_back(offset, count);
+        for (size_t i = 0; i < count; i++)
+            values[i] = offset << 8 | i;
+    }
+
+    bool batches_transfers() const override
+    {
+        return true;
+    }
+};
+
+// 5 writes and 3 requests in a row reach the device in one call each, and
+// the EINR handler adds the data of the responses in R7
+void emem_test()
+{
+    using namespace ANC216;
+    Program program;
+    program.word(LDSP, 0x2000);
+    for (uint8_t i = 1; i <= 5; i++)
+        program.emit(0b00'001'110, WRITE, {TEST_BATCH_ADDR >> 8, (TEST_BATCH_ADDR & 0xFF) + 2, 0, i});
+    for (int i = 0; i < 3; i++)
+        program.word(REQ, TEST_BATCH_ADDR + 3);
+    uint16_t wait = program.here();
+    program.imm(CMP, 6, 3)
+        .word(JNE, wait)
+        .implied(KILL);
+    Program handler(0x0100);
+    handler.reg(INC, 6)
+        .reg_reg(ADD, 7, 1)
+        .emit(guest::low_reg(2), POP)
+        .reg(POP, 1)
+        .reg(POP, 0)
+        .implied(RET);
+
+    auto machine = make_machine(program);
+    machine->load_memory(handler.origin, handler.code);
+    machine->load_memory(TEST_VECTOR_EINR, {0x01, 0x00});
+    machine->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    auto device = new BatchDevice(machine->get_mapper(), machine->get_flags());
+    machine->map(TEST_BATCH_ADDR, device, 4);
+    run_to_end(*machine);
+
+    std::vector<std::vector<uint16_t>> writes = {{1, 2, 3, 4, 5}};
+    report("consecutive writes reach the device in one block", device->write_blocks == writes && device->single_transfers == 0);
+    std::vector<std::pair<uint16_t, size_t>> reads = {{3, 3}};
+    report("consecutive requests are read in one block at their offset", device->read_blocks == reads);
+    int16_t sum = 0x0300 + 0x0301 + 0x0302;
+    CPUInfo state = machine->get_state();
+    report("every response of the block reaches the guest", machine->finished() && state.reg[7] == sum);
+    if (state.reg[7] != sum)
+        std::cerr << EXPECTED_BUT_GOT(sum, state.reg[7]);
+}
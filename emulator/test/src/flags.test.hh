@@ -0,0 +1,160 @@
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_FLAGS_RESULTS 0x4000
+
+// N, O, Z and C in sr
+#define TEST_N 0b1000'0000
+#define TEST_O 0b0100'0000
+#define TEST_Z 0b0000'0010
+#define TEST_C 0b0000'0001
+
+struct FlagsCase
+{
+    uint8_t opcode;
+    uint16_t a;
+    uint16_t b;
+    bool byte = false;
+    // AND R1, R1 after the operation, which sets N and Z but keeps O and C
+    bool logical = false;
+};
+
+// The flags computed eagerly with wider integers, independently of how the
+// CPU derives them
+uint8_t eager_flags(const FlagsCase &test, uint16_t &result)
+{
+    using namespace ANC216;
+    int bits = test.byte ? 8 : 16;
+    uint32_t mask = (1u << bits) - 1;
+    auto sign = [bits](uint32_t value)
+    { return (int32_t)(value << (32 - bits)) >> (32 - bits); };
+
+    uint32_t a = test.a & mask, b = test.opcode == INC || test.opcode == DEC ? 1 : test.b & mask;
+    bool add = test.opcode == ADD || test.opcode == INC;
+    uint32_t wide = add ? a + b : a - b;
+    int32_t signed_wide = add ? sign(a) + sign(b) : sign(a) - sign(b);
+    uint32_t value = wide & mask;
+
+    uint8_t flags = 0;
+    if (add ? wide > mask : a < b)
+        flags |= TEST_C;
+    if (signed_wide != sign(value))
+        flags |= TEST_O;
+    if (test.opcode != CMP)
+        result = test.byte ? (test.a & 0xFF00) | value : value;
+    else
+        result = test.a;
+    if (test.logical)
+        value = result & mask;
+    if (value & (1u << (bits - 1)))
+        flags |= TEST_N;
+    if (value == 0)
+        flags |= TEST_Z;
+    return flags;
+}
+
+// Whether each conditional jump, from JEQ to JNN, should be taken
+std::vector<bool> eager_jumps(uint8_t flags)
+{
+    bool n = flags & TEST_N, o = flags & TEST_O, z = flags & TEST_Z;
+    return {z, !z, n == o, n == o && !z, n != o || z, n != o, o, !o, n, !n};
+}
+
+// R1 = a, R2 = b, then the operation. Every conditional jump skips a store
+// of 1 to its own word of the results, then SR and R1 are stored after them
+Program flags_program(const FlagsCase &test)
+{
+    using namespace ANC216;
+    Program program;
+    program.imm(LOAD, 7, 1)
+        .imm(LOAD, 1, test.a)
+        .imm(LOAD, 2, test.b);
+    if (test.opcode == INC || test.opcode == DEC)
+        program.emit(test.byte ? guest::low_reg(1) : guest::reg(1), test.opcode);
+    else
+        program.reg_reg(test.opcode, 1, 2);
+    if (test.logical)
+        program.reg_reg(AND, 1, 1);
+
+    for (uint8_t jump = JEQ; jump <= JNN; jump++)
+    {
+        uint16_t skip = program.here() + 8;
+        program.word(jump, skip).mem(STORE, 7, TEST_FLAGS_RESULTS + 2 * (jump - JEQ));
+    }
+    program.reg(TRSR, 3)
+        .mem(STORE, 3, TEST_FLAGS_RESULTS + 20)
+        .mem(STORE, 1, TEST_FLAGS_RESULTS + 22)
+        .implied(KILL);
+    return program;
+}
+
+// Compares the flags of one case, as read by TRSR and by the conditional
+// jumps, with the eager ones
+bool same_flags(const FlagsCase &test, bool block_engine)
+{
+    auto machine = make_machine(flags_program(test), block_engine);
+    run_to_end(*machine);
+    std::vector<uint8_t> results = machine->read_memory(TEST_FLAGS_RESULTS, 24);
+    auto word = [&results](int i)
+    { return (uint16_t)(results[2 * i] << 8 | results[2 * i + 1]); };
+
+    uint16_t expected_result = 0;
+    uint8_t expected = eager_flags(test, expected_result);
+    std::vector<bool> expected_jumps = eager_jumps(expected);
+    uint8_t flags = word(10) & (TEST_N | TEST_O | TEST_Z | TEST_C);
+    bool same = machine->finished() && flags == expected && word(11) == expected_result;
+    for (int i = 0; i < 10; i++)
+        same = same && (word(i) == 0) == expected_jumps[i];
+    if (!same)
+        std::cerr << "\topcode " << (int)test.opcode << " a " << test.a << " b " << test.b
+                  << EXPECTED_BUT_GOT("sr " << (int)expected << " result " << expected_result,
+                                      "sr " << (int)flags << " result " << word(11));
+    return same;
+}
+
+void flags_test()
+{
+    using namespace ANC216;
+    std::vector<FlagsCase> cases = {
+        {ADD, 1, 2},
+        {ADD, 0x7FFF, 1},
+        {ADD, 0xFFFF, 1},
+        {ADD, 0x8000, 0x8000},
+        {ADD, 0xFFFF, 0xFFFF},
+        {ADD, 0, 0},
+        {SUB, 5, 3},
+        {SUB, 3, 5},
+        {SUB, 0x8000, 1},
+        {SUB, 0x7FFF, 0xFFFF},
+        {SUB, 5, 5},
+        {CMP, 5, 3},
+        {CMP, 3, 5},
+        {CMP, 0x8000, 1},
+        {CMP, 7, 7},
+        {CMP, 0xFFFE, 0xFFFF},
+        {INC, 0x7FFF, 0},
+        {INC, 0xFFFF, 0},
+        {DEC, 0x8000, 0},
+        {DEC, 0, 0},
+        {DEC, 1, 0},
+        {INC, 0x127F, 0, true},
+        {INC, 0x12FF, 0, true},
+        {DEC, 0x1280, 0, true},
+        {DEC, 0x1200, 0, true},
+        {ADD, 0x8000, 0x8000, false, true},
+        {ADD, 0xFFFF, 0xFFFF, false, true},
+        {SUB, 0x7FFF, 0xFFFF, false, true},
+    };
+
+    for (bool block_engine : {false, true})
+    {
+        bool same = true;
+        for (const FlagsCase &test : cases)
+            same = same_flags(test, block_engine) && same;
+        report(std::string("lazy flags and conditional jumps match eager flags with the ") +
+                   (block_engine ? "block engine" : "interpreter"),
+               same);
+    }
+}
@@ -0,0 +1,108 @@
+#include <anc216.hh>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#pragma once
+
+// Addressing bytes of the modes the tests use, laid out like in
+// CPU::decode_addressing: 2 bits of family, then x1 and x2
+namespace guest
+{
+    constexpr uint8_t IMPLIED = 0b00'000'000;
+    constexpr uint8_t IMMEDIATE_WORD = 0b00'010'000;
+    constexpr uint8_t ABSOLUTE = 0b10'000'000;
+
+    constexpr uint8_t reg(uint8_t r) { return 0b00'000'001 | r << 3; }
+    constexpr uint8_t low_reg(uint8_t r) { return 0b00'000'010 | r << 3; }
+    constexpr uint8_t reg_reg(uint8_t x1, uint8_t x2) { return 0b01'000'000 | x1 << 3 | x2; }
+    constexpr uint8_t indexed(uint8_t r) { return 0b10'000'001 | r << 3; }
+    constexpr uint8_t indirect_indexed(uint8_t r) { return 0b10'000'011 | r << 3; }
+    constexpr uint8_t absolute_to_reg(uint8_t r) { return 0b11'000'000 | r << 3; }
+    constexpr uint8_t immediate_to_reg(uint8_t r) { return 0b11'000'001 | r << 3; }
+    constexpr uint8_t immediate_to_low_reg(uint8_t r) { return 0b11'000'101 | r << 3; }
+}
+
+// Guest code written instruction by instruction: the addressing byte, the
+// opcode, then the arguments big endian
+class Program
+{
+public:
+    uint16_t origin;
+    std::vector<uint8_t> code;
+
+    Program(uint16_t origin = ROM_ADDR) : origin(origin) {}
+
+    uint16_t here() const
+    {
+        return origin + code.size();
+    }
+
+    Program &emit(uint8_t addressing, uint8_t opcode, std::initializer_list<uint8_t> args = {})
+    {
+        code.push_back(addressing);
+        code.push_back(opcode);
+        code.insert(code.end(), args);
+        return *this;
+    }
+
+    Program &implied(uint8_t opcode)
+    {
+        return emit(guest::IMPLIED, opcode);
+    }
+
+    Program &reg(uint8_t opcode, uint8_t r)
+    {
+        return emit(guest::reg(r), opcode);
+    }
+
+    Program &reg_reg(uint8_t opcode, uint8_t x1, uint8_t x2)
+    {
+        return emit(guest::reg_reg(x1, x2), opcode);
+    }
+
+    // LOAD r, value and the other IMMEDIATE_TO_REGISTER forms
+    Program &imm(uint8_t opcode, uint8_t r, uint16_t value)
+    {
+        return emit(guest::immediate_to_reg(r), opcode, {(uint8_t)(value >> 8), (uint8_t)value});
+    }
+
+    Program &imm_low(uint8_t opcode, uint8_t r, uint8_t value)
+    {
+        return emit(guest::immediate_to_low_reg(r), opcode, {value});
+    }
+
+    // LOAD and STORE between r and the word at address
+    Program &mem(uint8_t opcode, uint8_t r, uint16_t address)
+    {
+        return emit(guest::absolute_to_reg(r), opcode, {(uint8_t)(address >> 8), (uint8_t)address});
+    }
+
+    Program &indexed(uint8_t opcode, uint8_t r, uint16_t address)
+    {
+        return emit(guest::indexed(r), opcode, {(uint8_t)(address >> 8), (uint8_t)address});
+    }
+
+    // JMP, Jcc, CALL, TIME and the other instructions taking a word
+    Program &word(uint8_t opcode, uint16_t value)
+    {
+        return emit(guest::IMMEDIATE_WORD, opcode, {(uint8_t)(value >> 8), (uint8_t)value});
+    }
+};
+
+// A machine running like --headless, with the program loaded at its origin
+inline std::unique_ptr<ANC216::Machine> make_machine(const Program &program, bool block_engine = false)
+{
+    ANC216::EmuFlags flags;
+    flags.block_engine = block_engine;
+    auto machine = std::make_unique<ANC216::Machine>(flags);
+    machine->load_memory(program.origin, program.code);
+    return machine;
+}
+
+// Runs until the guest exits, at most limit cycles
+inline void run_to_end(ANC216::Machine &machine, uint64_t limit = 1'000'000)
+{
+    for (uint64_t cycles = 0; cycles < limit && machine.run(1000); cycles += 1000)
+        ;
+}
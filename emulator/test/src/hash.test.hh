@@ -0,0 +1,41 @@
+#include <hash.hh>
+#include "common.hh"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+#pragma once
+
+struct HashVector
+{
+    const char *data;
+    uint64_t seed;
+    uint64_t expected;
+};
+
+// Values given by the reference xxHash library
+static const HashVector HASH_VECTORS[] = {
+    {"", 0, 0xEF46DB3751D8E999},
+    {"a", 0, 0xD24EC4F1A98C6E5B},
+    {"abc", 0, 0x44BC2CF5AD770999},
+    {"Nobody inspects the spammish repetition", 0, 0xFBCEA83C8A378BF1},
+};
+
+std::string hex64(uint64_t value)
+{
+    std::stringstream str;
+    str << std::hex << std::setw(16) << std::setfill('0') << value;
+    return str.str();
+}
+
+void hash_test()
+{
+    for (auto &vector : HASH_VECTORS)
+    {
+        const std::string name = std::string("xxh64 of \"") + vector.data + "\"";
+        uint64_t hash = ANC216::xxh64(vector.data, std::strlen(vector.data), vector.seed);
+        report(name, hash == vector.expected);
+        if (hash != vector.expected)
+            std::cerr << EXPECTED_BUT_GOT(hex64(vector.expected), hex64(hash));
+    }
+}
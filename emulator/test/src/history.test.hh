@@ -0,0 +1,109 @@
+#include <history.hh>
+#include <algorithm>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include "interrupts.test.hh"
+#include "blocks.test.hh"
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_COUNTER_ADDR 0xFFF0
+
+// Every read returns the next number, so a replay that read the device
+// again instead of using the logged data would diverge
+class CounterDevice : public ANC216::Device
+{
+private:
+    uint16_t count = 0;
+
+public:
+    CounterDevice(ANC216::EmemMapper *emem, ANC216::EmuFlags flags) : Device(emem, flags)
+    {
+        this->id = ANC216::ROM;
+    }
+
+    void cpu_write(uint16_t, bool) override
+    {
+    }
+
+    uint16_t cpu_read(uint16_t, bool) override
+    {
+        return ++count;
+    }
+};
+
+// The history needs the debug mode, which a Machine turns off, so the CPU
+// is built like the emulator does. Forward execution one step at a time is
+// recorded, then the history goes back and forth to some of the steps
+void history_test()
+{
+    using namespace ANC216;
+    EmuFlags flags;
+    flags.debug_mode = true;
+    flags.headless = true;
+    flags.history_size = 64;
+    flags.checkpoint_interval = 256;
+    EmemMapper mapper(flags);
+    CPU cpu(&mapper, flags);
+    mapper.set_cpu(&cpu);
+    std::ostringstream discard;
+    cpu.set_output(&discard, &discard);
+
+    // The main loop adds what it reads to R2 and stores it, the timer
+    // handler counts in R3
+    Program program;
+    program.word(LDSP, 0x2000).word(TIME, 1).implied(TSTART);
+    uint16_t loop = program.here();
+    program.reg(INC, 0)
+        .word(READ, TEST_COUNTER_ADDR)
+        .reg_reg(ADD, 2, 1)
+        .mem(STORE, 2, 0x4000)
+        .word(JMP, loop);
+    Program handler(0x0100);
+    handler.reg(INC, 3).implied(RET);
+    cpu.load_memory(program.origin, program.code);
+    cpu.load_memory(handler.origin, handler.code);
+    cpu.load_memory(TEST_VECTOR_TIMER, {0x01, 0x00});
+    cpu.load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    mapper.map(TEST_COUNTER_ADDR, new CounterDevice(&mapper, flags));
+    cpu.start();
+
+    const std::vector<uint64_t> targets = {2999, 137, 1000, 2500, 0, 1999};
+    std::vector<CPUInfo> states = {cpu.get_info()};
+    std::map<uint64_t, std::vector<uint8_t>> memory = {{0, cpu.read_memory(0, 0xFFFF)}};
+    for (uint64_t i = 1; i < 3000; i++)
+    {
+        cpu.step();
+        states.push_back(cpu.get_info());
+        if (std::find(targets.begin(), targets.end(), i) != targets.end())
+            memory[i] = cpu.read_memory(0, 0xFFFF);
+    }
+
+    History *history = cpu.get_history();
+    bool same = true;
+    for (uint64_t target : targets)
+    {
+        history->go_to(target);
+        CPUInfo state = cpu.get_info();
+        if (!same_state(states[target], state) || cpu.read_memory(0, 0xFFFF) != memory[target])
+        {
+            std::cerr << "\tinstruction " << target << EXPECTED_BUT_GOT(states[target], state);
+            same = false;
+        }
+    }
+    report("history replays like the forward execution", same && states.back().reg[3] > 0);
+
+    bool thrown = false;
+    try
+    {
+        history->go_to(3000);
+    }
+    catch (const std::out_of_range &)
+    {
+        thrown = true;
+    }
+    report("history refuses to go past the newest instruction", thrown);
+}
@@ -0,0 +1,85 @@
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_VECTOR_EINR 0x0002
+#define TEST_VECTOR_NMI 0x0004
+#define TEST_VECTOR_TIMER 0x0008
+#define TEST_SYSTEM_SP 0x000C
+#define TEST_SYSTEM_STACK 0x3000
+
+// The timer handler adds 12 to R1 and returns with RET, the main loop
+// counts in R0 until the handler ran 3 times
+Program timer_program(uint16_t &handler)
+{
+    using namespace ANC216;
+    Program program;
+    program.word(LDSP, 0x2000)
+        .word(LDBP, 0x2100)
+        .word(TIME, 1)
+        .implied(TSTART);
+    uint16_t loop = program.here();
+    for (int i = 0; i < 8; i++)
+        program.reg(INC, 0);
+    program.imm(CMP, 1, 36)
+        .word(JNE, loop)
+        .implied(TSTOP)
+        .implied(KILL);
+
+    handler = program.here();
+    for (int i = 0; i < 12; i++)
+        program.reg(INC, 1);
+    program.implied(RET);
+    return program;
+}
+
+// The vector and the system stack pointer are loaded in the first bytes
+// of the memory
+std::unique_ptr<ANC216::Machine> make_timer_machine(bool block_engine = false)
+{
+    uint16_t handler;
+    auto machine = make_machine(timer_program(handler), block_engine);
+    machine->load_memory(TEST_VECTOR_TIMER, {(uint8_t)(handler >> 8), (uint8_t)handler});
+    machine->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    return machine;
+}
+
+void interrupts_test()
+{
+    auto machine = make_timer_machine();
+    run_to_end(*machine);
+    ANC216::CPUInfo state = machine->get_state();
+
+    report("timer handler returns to the interrupted loop", machine->finished() && state.reg[1] == 36);
+    if (state.reg[1] != 36)
+        std::cerr << EXPECTED_BUT_GOT(36, state.reg[1]);
+    report("interrupted SP and BP are restored", state.sp == 0x2000 && state.bp == 0x2100);
+    if (state.sp != 0x2000 || state.bp != 0x2100)
+        std::cerr << EXPECTED_BUT_GOT("SP 8192 BP 8448", "SP " << state.sp << " BP " << state.bp);
+    // Interrupts enabled again and privileges as before the first interrupt
+    report("interrupted SR is restored", (state.sr & 0b0011'1100) == 0b0011'1100);
+}
+
+// An unknown opcode (2 cycles) raises an NMI, whose handler is a KILL (1
+// cycle). Everything else is the cost of entering the handler
+void interrupt_cycles_test()
+{
+    using namespace ANC216;
+    Program program;
+    program.emit(guest::IMPLIED, 0xFF);
+    Program handler(0x0100);
+    handler.implied(KILL);
+
+    auto machine = make_machine(program);
+    machine->load_memory(handler.origin, handler.code);
+    machine->load_memory(TEST_VECTOR_NMI, {0x01, 0x00});
+    machine->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    run_to_end(*machine);
+
+    uint64_t expected = instruction_cycles(0xFF) + interrupt_cycles + instruction_cycles(KILL);
+    uint64_t cycles = machine->get_state().cycles;
+    report("entering an interrupt handler costs interrupt_cycles", cycles == expected);
+    if (cycles != expected)
+        std::cerr << EXPECTED_BUT_GOT(expected, cycles);
+}
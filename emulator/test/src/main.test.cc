@@ -0,0 +1,30 @@
+#include "decoder.test.hh"
+#include "addressing.test.hh"
+#include "flags.test.hh"
+#include "interrupts.test.hh"
+#include "blocks.test.hh"
+#include "emem.test.hh"
+#include "scheduler.test.hh"
+#include "snapshot.test.hh"
+#include "history.test.hh"
+#include "pixels.test.hh"
+#include "hash.test.hh"
+#include "common.hh"
+
+int main()
+{
+    decoder_test();
+    addressing_test();
+    flags_test();
+    interrupts_test();
+    interrupt_cycles_test();
+    blocks_test();
+    emem_test();
+    scheduler_test();
+    timer_test();
+    snapshot_test();
+    history_test();
+    pixels_test();
+    hash_test();
+    return failures == 0 ? 0 : 1;
+}
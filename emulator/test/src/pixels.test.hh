@@ -0,0 +1,56 @@
+#include <pixels.hh>
+#include "common.hh"
+#include <cstdlib>
+#include <vector>
+
+#pragma once
+
+// Runs every kernel of the set on the same random input as the scalar
+// set, for all the lengths around the vector widths
+bool same_as_scalar(const ANC216::PixelKernels &kernels)
+{
+    const ANC216::PixelKernels &scalar = *ANC216::supported_pixel_kernels().front();
+    uint32_t palette[256];
+    for (auto &color : palette)
+        color = std::rand();
+
+    for (size_t count = 0; count < 200; count++)
+    {
+        std::vector<uint8_t> in(count * 2 + 1), mask(count + 1), base(count + 1);
+        for (auto &byte : in)
+            byte = std::rand();
+        for (auto &byte : mask)
+            byte = std::rand() & 1 ? 0xFF : 0x00;
+        for (auto &byte : base)
+            byte = std::rand();
+
+        std::vector<uint32_t> colors[2] = {std::vector<uint32_t>(count + 1), std::vector<uint32_t>(count + 1)};
+        std::vector<uint8_t> filled[2] = {base, base}, selected[2] = {base, base}, copied[2] = {base, base};
+        const ANC216::PixelKernels *sets[2] = {&scalar, &kernels};
+        for (int i = 0; i < 2; i++)
+        {
+            sets[i]->palette(in.data(), colors[i].data(), count, palette);
+            sets[i]->fill(filled[i].data(), 0x5A, count);
+            sets[i]->select(in.data(), selected[i].data(), count, 0x11, 0x22);
+            sets[i]->masked_copy(in.data(), mask.data(), copied[i].data(), count);
+        }
+        if (colors[0] != colors[1] || filled[0] != filled[1] || selected[0] != selected[1] || copied[0] != copied[1])
+            return false;
+
+        for (int bits = 1; bits <= 8; bits *= 2)
+        {
+            std::vector<uint8_t> unpacked[2] = {base, base};
+            for (int i = 0; i < 2; i++)
+                sets[i]->unpack(in.data(), unpacked[i].data(), count, bits);
+            if (unpacked[0] != unpacked[1])
+                return false;
+        }
+    }
+    return true;
+}
+
+void pixels_test()
+{
+    for (auto kernels : ANC216::supported_pixel_kernels())
+        report(std::string("pixel kernels ") + kernels->name, same_as_scalar(*kernels));
+}
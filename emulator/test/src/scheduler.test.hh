@@ -0,0 +1,92 @@
+#include <scheduler.hh>
+#include <timer.hh>
+#include <string>
+#include "common.hh"
+
+#pragma once
+
+// Events due at the same cycle run in the order they were scheduled, and
+// cancelled ones are skipped whether they are at the top or not
+void scheduler_test()
+{
+    using namespace ANC216;
+    Scheduler scheduler;
+    std::string order;
+    std::vector<uint64_t> due;
+    auto event = [&](char name)
+    {
+        return [&order, &due, name](uint64_t when)
+        {
+            order += name;
+            due.push_back(when);
+        };
+    };
+
+    scheduler.schedule(30, event('a'));
+    scheduler.schedule(10, event('b'));
+    EventId c = scheduler.schedule(20, event('c'));
+    scheduler.schedule(10, event('d'));
+    scheduler.schedule(20, event('e'));
+
+    scheduler.run_due(15);
+    report("events run by cycle then by scheduling order", order == "bd" && scheduler.next_due() == 20);
+    report("actions get the cycle they were due at", due == std::vector<uint64_t>{10, 10});
+
+    scheduler.cancel(c);
+    scheduler.run_due(25);
+    report("cancelled events are skipped", order == "bde");
+    EventId f = scheduler.schedule(28, event('f'));
+    scheduler.cancel(f);
+    report("a cancelled event at the top is not due", scheduler.next_due() == 30);
+
+    scheduler.run_due(100);
+    report("every event ran once", order == "bdea" && scheduler.next_due() == NO_EVENT);
+    if (order != "bdea")
+        std::cerr << EXPECTED_BUT_GOT("bdea", order);
+}
+
+// The timer expires every period from where it was started, a restart
+// drops the pending expiry and a period of 0 stops it after the next one
+void timer_test()
+{
+    using namespace ANC216;
+    const uint64_t ms = CPU_CLOCK_HZ / 1000;
+    Scheduler scheduler;
+    int expiries = 0;
+    Timer timer(scheduler, [&expiries]()
+                { expiries++; });
+
+    timer.set_period(2);
+    timer.start(100);
+    report("timer remaining time is rounded up", timer.remaining(100) == 2 && timer.remaining(100 + ms + 1) == 1);
+    scheduler.run_due(100 + 2 * ms - 1);
+    bool early = expiries != 0;
+    scheduler.run_due(100 + 6 * ms);
+    report("timer expires every period", !early && expiries == 3 && timer.is_running());
+    if (early || expiries != 3)
+        std::cerr << EXPECTED_BUT_GOT(3, expiries);
+
+    // Restarted 1 ms before the next expiry, which is dropped
+    uint64_t restart = 100 + 7 * ms;
+    timer.start(restart);
+    scheduler.run_due(restart + 2 * ms - 1);
+    report("restarting the timer drops the pending expiry", expiries == 3 && timer.remaining(restart) == 2);
+
+    timer.set_period(5);
+    scheduler.run_due(restart + 2 * ms);
+    scheduler.run_due(restart + 7 * ms - 1);
+    bool changed_early = expiries != 4;
+    scheduler.run_due(restart + 7 * ms);
+    report("a new period takes effect at the next expiry", !changed_early && expiries == 5);
+
+    timer.set_period(0);
+    scheduler.run_due(restart + 12 * ms);
+    scheduler.run_due(restart + 100 * ms);
+    report("a period of 0 stops the timer after the next expiry", expiries == 6 && !timer.is_running());
+
+    timer.set_period(1);
+    timer.start(0);
+    timer.stop();
+    scheduler.run_due(10 * ms);
+    report("a stopped timer does not expire", expiries == 6 && !timer.is_running() && timer.remaining(0) == 0);
+}
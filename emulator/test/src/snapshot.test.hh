@@ -0,0 +1,83 @@
+#include <filesystem>
+#include "interrupts.test.hh"
+#include "blocks.test.hh"
+#include "guest.hh"
+#include "common.hh"
+
+#pragma once
+
+#define TEST_SNAPSHOT_DATA 0x4000
+
+// The main loop stores its counter in memory while the timer handler
+// counts in R1, so snapshots catch registers, memory, the stack and a
+// pending timer
+std::unique_ptr<ANC216::Machine> make_snapshot_machine()
+{
+    using namespace ANC216;
+    Program program;
+    program.word(LDSP, 0x2000).word(TIME, 1).implied(TSTART);
+    uint16_t loop = program.here();
+    program.reg(INC, 0)
+        .mem(STORE, 0, TEST_SNAPSHOT_DATA)
+        .word(JMP, loop);
+    Program handler(0x0100);
+    handler.reg(INC, 1).implied(RET);
+
+    auto machine = make_machine(program);
+    machine->load_memory(handler.origin, handler.code);
+    machine->load_memory(TEST_VECTOR_TIMER, {0x01, 0x00});
+    machine->load_memory(TEST_SYSTEM_SP, {TEST_SYSTEM_STACK >> 8, TEST_SYSTEM_STACK & 0xFF});
+    return machine;
+}
+
+bool same_machines(ANC216::Machine &a, ANC216::Machine &b)
+{
+    return same_state(a.get_state(), b.get_state()) && a.read_memory(0, 0xFFFF) == b.read_memory(0, 0xFFFF);
+}
+
+void snapshot_test()
+{
+    using namespace ANC216;
+    auto machine = make_snapshot_machine();
+    for (int i = 0; i < 3; i++)
+        machine->run(1000);
+    Snapshot first = machine->get_cpu().take_snapshot();
+    CPUInfo first_state = machine->get_state();
+    std::vector<uint8_t> first_memory = machine->read_memory(0, 0xFFFF);
+
+    machine->run(1000);
+    Snapshot second = machine->get_cpu().take_snapshot();
+    report("snapshots share the pages not written between them",
+           first.imem[ROM_ADDR / PAGE_SIZE] == second.imem[ROM_ADDR / PAGE_SIZE] &&
+               first.imem[0x1000 / PAGE_SIZE] == second.imem[0x1000 / PAGE_SIZE]);
+    report("snapshots copy the pages written between them",
+           first.imem[TEST_SNAPSHOT_DATA / PAGE_SIZE] != second.imem[TEST_SNAPSHOT_DATA / PAGE_SIZE]);
+
+    // Saved, loaded and restored in a new machine, which then runs like
+    // the original one
+    std::string filename = (std::filesystem::temp_directory_path() / "anc216_test.snapshot").string();
+    save_snapshot(filename, second);
+    Snapshot loaded = load_snapshot(filename);
+    std::filesystem::remove(filename);
+    auto restored = make_snapshot_machine();
+    restored->get_cpu().restore_snapshot(loaded);
+    report("a loaded snapshot restores the state and the memory", same_machines(*machine, *restored));
+
+    bool same = true;
+    for (int i = 0; i < 20 && same; i++)
+    {
+        machine->run(1000);
+        restored->run(1000);
+        same = same_machines(*machine, *restored);
+    }
+    CPUInfo state = restored->get_state();
+    report("a restored machine runs like the original one", same && state.reg[1] > 0);
+    if (!same)
+        std::cerr << EXPECTED_BUT_GOT(machine->get_state(), state);
+
+    // Back to the first snapshot in the same machine, where most pages are
+    // still shared with it
+    machine->get_cpu().restore_snapshot(first);
+    report("restoring an earlier snapshot goes back to its state",
+           same_state(first_state, machine->get_state()) && machine->read_memory(0, 0xFFFF) == first_memory);
+}